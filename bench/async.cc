@@ -0,0 +1,113 @@
+/* Copyright 2026 (c), Yao Zeran, Zhang Chenzhi
+ *
+ * Latency of the coroutine api on the reference loop executor, N decaps (64
+ *   by default, argv[1]) are kept in flight on one thread, a slice is one
+ *   resumption, i.e. how long the loop is held before it can serve anything
+ *   else, sync is the same load with one whole decap per slice. The async
+ *   results are checked against the sync api first. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../src/fips/include.h"
+#include "bench.h"
+
+/* Async key gen, encap and decap each paired with its sync counterpart, also
+ *   on a corrupted cipher for the implicit rejection path */
+template <typename P>
+static bool check(mlkem::param_set set) {
+  std::vector<uint8_t> ek(P::ek_len), dk(P::dk_len), c(P::cipher_len), c2(P::cipher_len);
+  uint8_t ss0[32], ss1[32], ss2[32], ss3[32];
+  mlkem::workspace ws;
+  mlkem::loop_executor ex;
+  int rc = 0, n = 0;
+  auto done = [&](int r) { rc |= r; ++n; };
+
+  mlkem::spawn(ex, mlkem::async_key_gen(ex, set, ek.data(), dk.data(), &ws), done);
+  ex.run();
+  mlkem::spawn(ex, mlkem::async_encap(ex, set, c.data(), ss0, ek.data(), &ws), done);
+  ex.run();
+  mlkem::decap<P>(ss1, c.data(), dk.data());
+  mlkem::encap<P>(c2.data(), ss2, ek.data());
+  mlkem::spawn(ex, mlkem::async_decap(ex, set, ss3, c2.data(), dk.data(), &ws), done);
+  ex.run();
+  bool ok = rc == 0 && n == 3 && !memcmp(ss0, ss1, 32) && !memcmp(ss2, ss3, 32);
+
+  c2[7] ^= 1;
+  mlkem::decap<P>(ss1, c2.data(), dk.data());
+  mlkem::spawn(ex, mlkem::async_decap(ex, set, ss3, c2.data(), dk.data(), &ws), done);
+  ex.run();
+  return ok && rc == 0 && n == 4 && !memcmp(ss1, ss3, 32);
+}
+
+static void print_row(const char* mode, const bench::dist& d, double max, double ops) {
+  printf("  %-6s %10.0f %10.0f %10.0f %10.0f\n", mode, d.median, d.p99, max, ops);
+}
+
+template <typename P>
+static void run(const char* name, mlkem::param_set set, int inflight) {
+  const int rounds = 8;
+  const int nops = inflight * rounds;
+  std::vector<uint8_t> ek(P::ek_len), dk(P::dk_len);
+  std::vector<uint8_t> c(inflight * P::cipher_len), ss(inflight * 32);
+  std::vector<mlkem::workspace> ws(inflight);
+  std::vector<double> slice;
+  double max;
+  mlkem::key_gen<P>(ek.data(), dk.data());
+  for (int i = 0; i < inflight; ++i) { mlkem::encap<P>(&c[i * P::cipher_len], &ss[i * 32], ek.data()); }
+
+  printf("%s, %d in flight\n", name, inflight);
+  printf("  %-6s %10s %10s %10s %10s\n", "mode", "slice ns", "p99 ns", "max ns", "ops/s");
+
+  slice.clear();
+  max = 0;
+  uint64_t t0 = bench::now_ns();
+  for (int i = 0; i < nops; ++i) {
+    int l = i % inflight;
+    uint64_t s0 = bench::now_ns();
+    mlkem::decap(set, &ss[l * 32], &c[l * P::cipher_len], dk.data(), &ws[l]);
+    double s = (double)(bench::now_ns() - s0);
+    slice.push_back(s);
+    if (s > max) { max = s; }
+  }
+  double ops = nops / ((bench::now_ns() - t0) * 1e-9);
+  print_row("sync", bench::summarize(slice), max, ops);
+
+  mlkem::loop_executor ex;
+  slice.clear();
+  max = 0;
+  t0 = bench::now_ns();
+  for (int r = 0; r < rounds; ++r) {
+    for (int l = 0; l < inflight; ++l) {
+      mlkem::spawn(ex, mlkem::async_decap(ex, set, &ss[l * 32], &c[l * P::cipher_len], dk.data(), &ws[l]),
+        [](int) {});
+    }
+    for (;;) {
+      uint64_t s0 = bench::now_ns();
+      if (!ex.run_one()) { break; }
+      double s = (double)(bench::now_ns() - s0);
+      slice.push_back(s);
+      if (s > max) { max = s; }
+    }
+  }
+  ops = nops / ((bench::now_ns() - t0) * 1e-9);
+  print_row("async", bench::summarize(slice), max, ops);
+}
+
+int main(int argc, char* argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : 64;
+  if (n <= 0) { n = 1; }
+
+  bool ok = check<mlkem::mlkem512>(mlkem::param_set::mlkem512) &&
+    check<mlkem::mlkem768>(mlkem::param_set::mlkem768) &&
+    check<mlkem::mlkem1024>(mlkem::param_set::mlkem1024);
+  printf("async vs sync: %s\n", ok ? "ok" : "MISMATCH");
+  if (!ok) { return 1; }
+
+  run<mlkem::mlkem512>("ML-KEM-512", mlkem::param_set::mlkem512, n);
+  run<mlkem::mlkem768>("ML-KEM-768", mlkem::param_set::mlkem768, n);
+  run<mlkem::mlkem1024>("ML-KEM-1024", mlkem::param_set::mlkem1024, n);
+  return 0;
+}
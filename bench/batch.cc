@@ -0,0 +1,97 @@
+/* Copyright 2026 (c), Yao Zeran, Zhang Chenzhi
+ *
+ * Per op cost of encap_batch and decap_batch against n calls of encap and 
+ *   decap with the same key, the batch results are checked against the 
+ *   single shot api first. */
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../src/fips/include.h"
+#include "bench.h"
+
+/* Every lane of encap_batch for n = 1..9, partial groups of four included,
+ *   must decap to its shared secret with single shot decap, and no two lanes
+ *   may share their randomness */
+template <typename P>
+static bool check_encap() {
+  const int max_n = 9;
+  std::vector<uint8_t> ek(P::ek_len), dk(P::dk_len);
+  std::vector<uint8_t> c(max_n * P::cipher_len), ss(max_n * 32);
+  uint8_t x[32];
+  mlkem::key_gen<P>(ek.data(), dk.data());
+  for (int n = 1; n <= max_n; ++n) {
+    mlkem::encap_batch<P>(c.data(), ss.data(), n, ek.data());
+    for (int i = 0; i < n; ++i) {
+      mlkem::decap<P>(x, &c[i * P::cipher_len], dk.data());
+      if (memcmp(x, &ss[i * 32], 32)) { return false; }
+      if (i > 0 && !memcmp(&ss[i * 32], &ss[(i - 1) * 32], 32)) { return false; }
+    }
+  }
+  return true;
+}
+
+/* decap_batch against single shot decap for n = 1..9, so idle lanes of the
+ *   last group are covered, every third cipher is corrupted to take the 
+ *   implicit rejection path */
+template <typename P>
+static bool check_decap() {
+  const int max_n = 37; /* whole groups of 16 and a tail */
+  std::vector<uint8_t> ek(P::ek_len), dk(P::dk_len);
+  std::vector<uint8_t> c(max_n * P::cipher_len), ss(max_n * 32), x(max_n * 32);
+  uint8_t y[32];
+  mlkem::key_gen<P>(ek.data(), dk.data());
+  for (int i = 0; i < max_n; ++i) {
+    mlkem::encap<P>(&c[i * P::cipher_len], &ss[i * 32], ek.data());
+    if (i % 3 == 2) { c[i * P::cipher_len + (i * 131) % P::cipher_len] ^= 1; }
+  }
+  for (int n = 1; n <= max_n; ++n) {
+    mlkem::decap_batch<P>(x.data(), c.data(), n, dk.data());
+    for (int i = 0; i < n; ++i) {
+      mlkem::decap<P>(y, &c[i * P::cipher_len], dk.data());
+      if (memcmp(y, &x[i * 32], 32)) { return false; }
+      if ((i % 3 == 2) == !memcmp(y, &ss[i * 32], 32)) { return false; }
+    }
+  }
+  return true;
+}
+
+template <typename P>
+static void run(const char* name) {
+  const int max_n = 64;
+  std::vector<uint8_t> ek(P::ek_len), dk(P::dk_len);
+  std::vector<uint8_t> c(max_n * P::cipher_len), ss(max_n * 32);
+  mlkem::key_gen<P>(ek.data(), dk.data());
+
+  printf("%s\n", name);
+  printf("  %4s %16s %16s %16s %16s\n", "n", "single ns/encap", "batch ns/encap", 
+    "single ns/decap", "batch ns/decap");
+  for (int n = 1; n <= max_n; n *= 2) {
+    double single_enc = bench::median_ns([&] {
+      for (int i = 0; i < n; ++i) { mlkem::encap<P>(&c[i * P::cipher_len], &ss[i * 32], ek.data()); }
+    }, 4) / n;
+    double batch_enc = bench::median_ns([&] {
+      mlkem::encap_batch<P>(c.data(), ss.data(), n, ek.data());
+    }, 4) / n;
+    double single_dec = bench::median_ns([&] {
+      for (int i = 0; i < n; ++i) { mlkem::decap<P>(&ss[i * 32], &c[i * P::cipher_len], dk.data()); }
+    }, 4) / n;
+    double batch_dec = bench::median_ns([&] {
+      mlkem::decap_batch<P>(ss.data(), c.data(), n, dk.data());
+    }, 4) / n;
+    printf("  %4d %16.0f %16.0f %16.0f %16.0f\n", n, single_enc, batch_enc, single_dec, batch_dec);
+  }
+}
+
+int main() {
+  bool ok = check_encap<mlkem::mlkem512>() && check_encap<mlkem::mlkem768>() && check_encap<mlkem::mlkem1024>()
+    && check_decap<mlkem::mlkem512>() && check_decap<mlkem::mlkem768>() && check_decap<mlkem::mlkem1024>();
+  printf("batch vs single: %s\n", ok ? "ok" : "MISMATCH");
+  if (!ok) { return 1; }
+
+  run<mlkem::mlkem512>("ML-KEM-512");
+  run<mlkem::mlkem768>("ML-KEM-768");
+  run<mlkem::mlkem1024>("ML-KEM-1024");
+  return 0;
+}
@@ -0,0 +1,140 @@
+/* Copyright 2026 (c), Yao Zeran, Zhang Chenzhi
+ *
+ * The <bench.h> file defines timing helpers shared by the benchmarks. */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace bench
+{
+
+inline uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Keep the compiler from dropping stores to p made by a benchmarked call */
+inline void escape(const void* p) {
+#if defined(__GNUC__)
+  asm volatile("" : : "g"(p) : "memory");
+#endif
+}
+
+/* Time stamp counter, 0 where there is none */
+inline uint64_t now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* Time rounds of iters calls to f, return the median ns per call
+ * */
+template <typename F>
+inline double median_ns(F&& f, int iters, int rounds = 11) {
+  std::vector<double> r(rounds);
+  f(); /* warm up */
+  for (int i = 0; i < rounds; ++i) {
+    uint64_t t0 = now_ns();
+    for (int j = 0; j < iters; ++j) { f(); }
+    r[i] = (double)(now_ns() - t0) / iters;
+  }
+  std::sort(r.begin(), r.end());
+  return r[rounds / 2];
+}
+
+/* Distribution of the per call cost over all samples */
+typedef struct {
+  double min, median, p90, p99;
+} dist;
+
+typedef struct {
+  std::string name;
+  std::string set;
+  int iters;   /* calls per sample */
+  int samples;
+  dist ns;
+  dist cycles;
+} result;
+
+inline dist summarize(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  auto at = [&](double q) { return v[(size_t)(q * (v.size() - 1) + 0.5)]; };
+  return { v.front(), at(0.5), at(0.9), at(0.99) };
+}
+
+/* Sample f, each sample times enough back to back calls to take about 
+ *   min_sample_ns so that short kernels are not lost in timer overhead
+ * */
+template <typename F>
+inline result measure(const std::string& name, const std::string& set, F&& f, 
+    int samples, double min_sample_ns = 2000) {
+  for (int i = 0; i < 8; ++i) { f(); } /* warm up */
+  uint64_t t0 = now_ns();
+  for (int i = 0; i < 8; ++i) { f(); }
+  double est = (double)(now_ns() - t0) / 8;
+  int iters = (est >= min_sample_ns) ? 1 : (int)(min_sample_ns / (est + 1)) + 1;
+
+  std::vector<double> ns(samples), cyc(samples);
+  for (int s = 0; s < samples; ++s) {
+    uint64_t c0 = now_cycles();
+    uint64_t n0 = now_ns();
+    for (int j = 0; j < iters; ++j) { f(); }
+    uint64_t n1 = now_ns();
+    uint64_t c1 = now_cycles();
+    ns[s] = (double)(n1 - n0) / iters;
+    cyc[s] = (double)(c1 - c0) / iters;
+  }
+  return { name, set, iters, samples, summarize(ns), summarize(cyc) };
+}
+
+inline void print_header() {
+  printf("%-28s %-6s %10s %10s %10s %12s %12s\n", 
+    "name", "set", "ns/op", "p90 ns", "p99 ns", "cycles/op", "p99 cycles");
+}
+
+inline void print(const result& r) {
+  printf("%-28s %-6s %10.0f %10.0f %10.0f %12.0f %12.0f\n", r.name.c_str(), r.set.c_str(), 
+    r.ns.median, r.ns.p90, r.ns.p99, r.cycles.median, r.cycles.p99);
+}
+
+inline void write_dist(FILE* f, const char* key, const dist& d) {
+  fprintf(f, "\"%s\": {\"min\": %.1f, \"median\": %.1f, \"p90\": %.1f, \"p99\": %.1f}", 
+    key, d.min, d.median, d.p90, d.p99);
+}
+
+/* Write all results as one json object, ns and cycles are per call
+ * */
+inline bool write_json(const char* path, const std::vector<result>& rs, const std::string& cpu) {
+  FILE* f = fopen(path, "w");
+  if (!f) { return false; }
+  fprintf(f, "{\n  \"cpu\": \"%s\",\n  \"results\": [\n", cpu.c_str());
+  for (size_t i = 0; i < rs.size(); ++i) {
+    const result& r = rs[i];
+    fprintf(f, "    {\"name\": \"%s\", \"set\": \"%s\", \"iters\": %d, \"samples\": %d, ", 
+      r.name.c_str(), r.set.c_str(), r.iters, r.samples);
+    write_dist(f, "ns", r.ns);
+    fprintf(f, ", ");
+    write_dist(f, "cycles", r.cycles);
+    fprintf(f, "}%s\n", (i + 1 < rs.size()) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+  return true;
+}
+
+} /* namespace bench */
+
+#endif /* BENCH_H */
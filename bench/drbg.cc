@@ -0,0 +1,48 @@
+/* Copyright 2026 (c), Yao Zeran, Zhang Chenzhi
+ *
+ * Cost of one gen_rand_bytes call through the os system call and through the 
+ *   per thread drbg, with 1 to N threads drawing at once, N defaults to the 
+ *   number of cores and can be given as argv[1]. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+
+#include "../src/fips/include.h"
+#include "bench.h"
+
+/* Run f on t threads, return the wall clock ns per call of f */
+template <typename F>
+static double per_call_ns(unsigned int t, int calls, F f) {
+  std::vector<std::thread> th;
+  uint64_t t0 = bench::now_ns();
+  for (unsigned int i = 0; i < t; ++i) {
+    th.emplace_back([&] { for (int j = 0; j < calls; ++j) { f(); } });
+  }
+  for (auto& x : th) { x.join(); }
+  return (double)(bench::now_ns() - t0) / ((double)calls * t);
+}
+
+int main(int argc, char* argv[]) {
+  unsigned int n = (argc > 1) ? (unsigned int)atoi(argv[1]) : std::thread::hardware_concurrency();
+  if (n == 0) { n = 1; }
+  const int calls = 100000;
+
+  for (size_t len : { 32, 64 }) {
+    printf("%zu bytes per call\n", len);
+    printf("  %7s %14s %14s\n", "threads", "os ns/call", "drbg ns/call");
+    for (unsigned int t = 1; t <= n; ++t) {
+      double os = per_call_ns(t, calls, [len] {
+        uint8_t buf[64];
+        mlkem::gen_rand_bytes_os(buf, len);
+      });
+      double drbg = per_call_ns(t, calls, [len] {
+        uint8_t buf[64];
+        mlkem::gen_rand_bytes(buf, len);
+      });
+      printf("  %7u %14.1f %14.1f\n", t, os, drbg);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+/* Copyright 2026 (c), Yao Zeran, Zhang Chenzhi
+ *
+ * Throughput of the engine from 1 to N threads on a mixed key gen, encap and
+ *   decap load, N defaults to the number of cores and can be given as argv[1],
+ *   the engine results are checked against the sync api first. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <future>
+#include <thread>
+
+#include "../src/fips/include.h"
+#include "bench.h"
+
+/* Keys from engine key gen jobs, ciphers from engine encap jobs and secrets
+ *   from engine decap jobs, each decap against the sync one, every fourth 
+ *   cipher corrupted for the implicit rejection path */
+template <typename P>
+static bool check(mlkem::param_set set, unsigned int threads) {
+  const int n = 48;
+  std::vector<uint8_t> eks(n * P::ek_len), dks(n * P::dk_len);
+  std::vector<uint8_t> c(n * P::cipher_len), ss(n * 32), ss2(n * 32);
+  std::vector<std::future<int>> done(n);
+  uint8_t x[32];
+  int rc = 0;
+  mlkem::engine eng(threads);
+
+  for (int i = 0; i < n; ++i) { done[i] = eng.key_gen(set, &eks[i * P::ek_len], &dks[i * P::dk_len]); }
+  for (auto& f : done) { rc |= f.get(); }
+  for (int i = 0; i < n; ++i) {
+    done[i] = eng.encap(set, &c[i * P::cipher_len], &ss[i * 32], &eks[i * P::ek_len]);
+  }
+  for (auto& f : done) { rc |= f.get(); }
+  for (int i = 3; i < n; i += 4) { c[i * P::cipher_len + i] ^= 1; }
+  for (int i = 0; i < n; ++i) {
+    done[i] = eng.decap(set, &ss2[i * 32], &c[i * P::cipher_len], &dks[i * P::dk_len]);
+  }
+  for (auto& f : done) { rc |= f.get(); }
+
+  for (int i = 0; i < n; ++i) {
+    mlkem::decap<P>(x, &c[i * P::cipher_len], &dks[i * P::dk_len]);
+    if (memcmp(x, &ss2[i * 32], 32)) { return false; }
+    if ((i % 4 == 3) == !memcmp(x, &ss[i * 32], 32)) { return false; }
+  }
+  return rc == 0;
+}
+
+template <typename P>
+static void run(const char* name, mlkem::param_set set, unsigned int max_threads) {
+  const int njobs = 600; /* a third each of key gen, encap and decap */
+  std::vector<uint8_t> ek(P::ek_len), dk(P::dk_len);
+  std::vector<uint8_t> eks(njobs * P::ek_len), dks(njobs * P::dk_len);
+  std::vector<uint8_t> c(njobs * P::cipher_len), ss(njobs * 32);
+  std::vector<std::future<int>> done(njobs);
+  mlkem::key_gen<P>(ek.data(), dk.data());
+  for (int i = 0; i < njobs; ++i) { mlkem::encap<P>(&c[i * P::cipher_len], &ss[i * 32], ek.data()); }
+
+  printf("%s\n", name);
+  printf("  %7s %12s %8s\n", "threads", "ops/s", "scaling");
+  double base = 0;
+  for (unsigned int t = 1; t <= max_threads; ++t) {
+    mlkem::engine eng(t);
+    uint64_t t0 = bench::now_ns();
+    for (int i = 0; i < njobs; ++i) {
+      switch (i % 3) {
+        case 0: done[i] = eng.key_gen(set, &eks[i * P::ek_len], &dks[i * P::dk_len]); break;
+        case 1: done[i] = eng.encap(set, &c[i * P::cipher_len], &ss[i * 32], ek.data()); break;
+        case 2: done[i] = eng.decap(set, &ss[i * 32], &c[i * P::cipher_len], dk.data()); break;
+      }
+    }
+    for (auto& f : done) { f.get(); }
+    double ops = njobs / ((bench::now_ns() - t0) * 1e-9);
+    if (t == 1) { base = ops; }
+    printf("  %7u %12.0f %7.2fx\n", t, ops, ops / base);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  unsigned int n = (argc > 1) ? (unsigned int)atoi(argv[1]) : std::thread::hardware_concurrency();
+  if (n == 0) { n = 1; }
+
+  bool ok = check<mlkem::mlkem512>(mlkem::param_set::mlkem512, n) &&
+    check<mlkem::mlkem768>(mlkem::param_set::mlkem768, n) &&
+    check<mlkem::mlkem1024>(mlkem::param_set::mlkem1024, n);
+  printf("engine vs sync: %s\n", ok ? "ok" : "MISMATCH");
+  if (!ok) { return 1; }
+
+  run<mlkem::mlkem512>("ML-KEM-512", mlkem::param_set::mlkem512, n);
+  run<mlkem::mlkem768>("ML-KEM-768", mlkem::param_set::mlkem768, n);
+  run<mlkem::mlkem1024>("ML-KEM-1024", mlkem::param_set::mlkem1024, n);
+  return 0;
+}
@@ -0,0 +1,551 @@
+/* Copyright 2026 (c), Yao Zeran, Zhang Chenzhi
+ *
+ * Micro benchmarks of the kernels and macro benchmarks of key gen, encap and
+ *   decap for every parameter set
+ *
+ *   usage: bench [--json FILE] [--samples N] [--filter SUBSTR] [--check]
+ *
+ *   --check only runs the differential checks of the kernels */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../src/fips/include.h"
+#include "bench.h"
+
+static std::vector<bench::result> results;
+static int samples = 201;
+static const char* filter = nullptr;
+
+template <typename F>
+static void run(const std::string& name, const std::string& set, F&& f) {
+  if (filter && (name + " " + set).find(filter) == std::string::npos) { return; }
+  results.push_back(bench::measure(name, set, f, samples));
+  bench::print(results.back());
+}
+
+static void fill(uint8_t* p, size_t n) { mlkem::gen_rand_bytes(p, n); }
+
+static void fill_poly(mlkem::poly* p) {
+  uint8_t buf[mlkem::poly_len];
+  fill(buf, sizeof(buf));
+  mlkem::bytes_to_poly(p, buf);
+  mlkem::poly_reduce(p);
+}
+
+static void kernels() {
+  static mlkem::poly a, b, c;
+  static uint8_t buf[4 * sha::shake128_rate];
+  static uint8_t out[64];
+  alignas(32) static uint64_t s[25], s4[100];
+  fill_poly(&a);
+  fill_poly(&b);
+  fill(buf, sizeof(buf));
+
+  run("keccakf1600_state_permute", "-", [&] { sha::keccakf1600_state_permute(s); bench::escape(s); });
+  run("keccakf1600_state_permute_scalar", "-", [&] { sha::keccakf1600_state_permute_scalar(s); bench::escape(s); });
+  run("keccakx4_permute", "-", [&] { sha::keccakx4_permute(s4); bench::escape(s4); });
+  run("sha3_512", "-", [&] { sha::sha3_512(out, buf, 64); bench::escape(out); });
+  run("ntt", "-", [&] { c = a; mlkem::ntt(c.coeffs); bench::escape(&c); });
+  run("ntt_scalar", "-", [&] { c = a; mlkem::ntt_scalar(c.coeffs); bench::escape(&c); });
+  run("invntt", "-", [&] { c = a; mlkem::invntt(c.coeffs); bench::escape(&c); });
+  run("invntt_scalar", "-", [&] { c = a; mlkem::invntt_scalar(c.coeffs); bench::escape(&c); });
+  run("poly_reduce", "-", [&] { c = a; mlkem::poly_reduce(&c); bench::escape(&c); });
+  run("poly_basemul", "-", [&] { mlkem::poly_basemul(&c, &a, &b); bench::escape(&c); });
+  run("rej_sample_uniform", "-", [&] { mlkem::rej_sample_uniform(c.coeffs, mlkem::mlkem_n, buf, sizeof(buf)); bench::escape(&c); });
+  run("rej_sample_uniform_scalar", "-", [&] { mlkem::rej_sample_uniform_scalar(c.coeffs, mlkem::mlkem_n, buf, sizeof(buf)); bench::escape(&c); });
+  run("cbd2", "-", [&] { mlkem::cbd2(&c, buf); bench::escape(&c); });
+  run("cbd2_scalar", "-", [&] { mlkem::cbd2_scalar(&c, buf); bench::escape(&c); });
+  run("cbd3", "-", [&] { mlkem::cbd3(&c, buf); bench::escape(&c); });
+  run("cbd3_scalar", "-", [&] { mlkem::cbd3_scalar(&c, buf); bench::escape(&c); });
+  static mlkem::poly_soa<> sa[4], sb[4];
+  static mlkem::poly v16[16];
+  for (int l = 0; l < 16; ++l) {
+    fill_poly(&v16[l]);
+    for (int i = 0; i < 4; ++i) {
+      mlkem::poly_soa_load(&sa[i], l, &v16[l]);
+      mlkem::poly_soa_load(&sb[i], l, &v16[(l + i) % 16]);
+    }
+  }
+  run("ntt x16", "-", [&] { for (auto& x : v16) { mlkem::ntt(x.coeffs); } bench::escape(v16); });
+  run("poly_soa_ntt", "16", [&] { mlkem::poly_soa_ntt(&sa[0]); bench::escape(&sa[0]); });
+  run("invntt x16", "-", [&] { for (auto& x : v16) { mlkem::invntt(x.coeffs); } bench::escape(v16); });
+  run("poly_soa_invntt", "16", [&] { mlkem::poly_soa_invntt(&sa[0]); bench::escape(&sa[0]); });
+  run("poly_soa_basemul_acc<4>", "16", [&] { mlkem::poly_soa_basemul_acc<4>(&sa[0], sa, sb); bench::escape(&sa[0]); });
+  static mlkem::poly_vec<mlkem::mlkem1024> sv;
+  static mlkem::poly_vec_mulcache<mlkem::mlkem1024> svc;
+  for (int i = 0; i < 4; ++i) { sv.vec[i] = v16[i]; }
+  mlkem::poly_vec_mulcache_compute(&svc, &sv);
+  run("poly_soa_basemul_acc_shared<4>", "16", [&] { mlkem::poly_soa_basemul_acc_shared<4>(&sa[0], sa, sv.vec, svc.vec); bench::escape(&sa[0]); });
+  run("poly_to_msg", "-", [&] { mlkem::poly_to_msg(out, &a); bench::escape(out); });
+  run("poly_to_msg_scalar", "-", [&] { mlkem::poly_to_msg_scalar(out, &a); bench::escape(out); });
+  run("msg_to_poly", "-", [&] { mlkem::msg_to_poly(&c, out); bench::escape(&c); });
+  run("msg_to_poly_scalar", "-", [&] { mlkem::msg_to_poly_scalar(&c, out); bench::escape(&c); });
+}
+
+#if MLKEM_HAS_AVX2
+
+/* Random coefficients in (-q, q), every value of one block of the range, or
+ *   any int16, the inputs the compression kernels must agree on */
+static void fill_any(mlkem::poly* p, int round) {
+  int16_t r[mlkem::mlkem_n];
+  fill((uint8_t*)r, sizeof(r));
+  for (int i = 0; i < mlkem::mlkem_n; ++i) {
+    if (round < 26) {
+      p->coeffs[i] = (int16_t)(round * mlkem::mlkem_n + i - (mlkem::mlkem_q - 1) / 2);
+    } else if (round % 4) {
+      p->coeffs[i] = (int16_t)((uint16_t)r[i] % (2 * mlkem::mlkem_q - 1) - (mlkem::mlkem_q - 1));
+    } else {
+      p->coeffs[i] = r[i];
+    }
+  }
+}
+
+/* Random coefficients in [-b, b], every other round only -b and b */
+static void fill_bounded(mlkem::poly* p, int32_t b, int round) {
+  uint16_t r[mlkem::mlkem_n];
+  fill((uint8_t*)r, sizeof(r));
+  for (int i = 0; i < mlkem::mlkem_n; ++i) {
+    p->coeffs[i] = (int16_t)((round % 2) ? ((r[i] & 1) ? b : -b) : (int32_t)(r[i] % (2 * b + 1)) - b);
+  }
+}
+
+/* Raw ntt and invntt outputs, not reduced afterwards, on inputs up to the 
+ *   largest bound the kem feeds them */
+static bool check_ntt(int rounds) {
+  mlkem::poly a, b;
+  for (int i = 0; i < rounds; ++i) {
+    fill_bounded(&a, mlkem::bytes_bound, i);
+    b = a;
+    mlkem::ntt_scalar(a.coeffs);
+    mlkem::ntt_avx2(b.coeffs);
+    if (memcmp(&a, &b, sizeof(a))) { return false; }
+    fill_bounded(&a, mlkem::barrett_bound, i);
+    b = a;
+    mlkem::invntt_scalar(a.coeffs);
+    mlkem::invntt_avx2(b.coeffs);
+    if (memcmp(&a, &b, sizeof(a))) { return false; }
+  }
+  return true;
+}
+
+/* Rejection sampler on random buffers, all 0xff buffers (every candidate 
+ *   rejected) and buffers with random 0xff runs, len and buflen vary so the
+ *   avx2 loop hands over to the scalar tail at every offset, nothing may be
+ *   written past len */
+static bool check_rej(int rounds) {
+  constexpr unsigned int max_len = mlkem::mlkem_n, max_buflen = 3 * sha::shake128_rate;
+  int16_t x[max_len + 16], y[max_len + 16];
+  uint8_t buf[max_buflen];
+  for (int i = 0; i < rounds; ++i) {
+    unsigned int len = (unsigned int)i % (max_len + 1);
+    unsigned int buflen = (unsigned int)(i * 7) % (max_buflen + 1);
+    fill(buf, sizeof(buf));
+    if (i % 3 == 1) { memset(buf, 0xff, sizeof(buf)); }
+    if (i % 3 == 2) {
+      for (unsigned int j = 0; j < max_buflen; j += 24) {
+        if (buf[j] & 1) { memset(buf + j, 0xff, (max_buflen - j < 24) ? max_buflen - j : 24); }
+      }
+    }
+    memset(x, 0x5a, sizeof(x));
+    memset(y, 0x5a, sizeof(y));
+    unsigned int n = mlkem::rej_sample_uniform_scalar(x, len, buf, buflen);
+    if (mlkem::rej_sample_uniform_avx2(y, len, buf, buflen) != n) { return false; }
+    if (memcmp(x, y, n * sizeof(int16_t))) { return false; }
+    if (memcmp(x + len, y + len, sizeof(x) - len * sizeof(int16_t))) { return false; }
+  }
+  return true;
+}
+
+/* cbd2 and cbd3 on random, all 0 and all 0xff bytes, the input is an exact
+ *   size heap buffer so the padded last block of cbd3 cannot read past it 
+ *   unnoticed under asan */
+static bool check_cbd(int rounds) {
+  std::vector<uint8_t> b2(4 * mlkem::mlkem_n / 8), b3(6 * mlkem::mlkem_n / 8);
+  mlkem::poly a, b;
+  for (int i = 0; i < rounds; ++i) {
+    fill(b2.data(), b2.size());
+    fill(b3.data(), b3.size());
+    if (i % 4 == 1) {
+      memset(b2.data(), 0, b2.size());
+      memset(b3.data(), 0, b3.size());
+    } else if (i % 4 == 2) {
+      memset(b2.data(), 0xff, b2.size());
+      memset(b3.data(), 0xff, b3.size());
+    }
+    mlkem::cbd2_scalar(&a, b2.data());
+    mlkem::cbd2_avx2(&b, b2.data());
+    if (memcmp(&a, &b, sizeof(a))) { return false; }
+    mlkem::cbd3_scalar(&a, b3.data());
+    mlkem::cbd3_avx2(&b, b3.data());
+    if (memcmp(&a, &b, sizeof(a))) { return false; }
+  }
+  return true;
+}
+
+template <int d>
+static bool check_compress(int rounds) {
+  mlkem::poly a, b, c;
+  uint8_t x[d * mlkem::mlkem_n / 8], y[d * mlkem::mlkem_n / 8];
+  for (int i = 0; i < rounds; ++i) {
+    fill_any(&a, i);
+    mlkem::poly_compress_scalar<d>(x, &a);
+    mlkem::poly_compress_avx2<d>(y, &a);
+    if (memcmp(x, y, sizeof(x))) { return false; }
+    fill(x, sizeof(x));
+    mlkem::poly_decompress_scalar<d>(&b, x);
+    mlkem::poly_decompress_avx2<d>(&c, x);
+    if (memcmp(&b, &c, sizeof(b))) { return false; }
+  }
+  return true;
+}
+
+static bool check_msg(int rounds) {
+  mlkem::poly a, b, c;
+  uint8_t x[mlkem::msg_len], y[mlkem::msg_len];
+  for (int i = 0; i < rounds; ++i) {
+    fill_any(&a, i);
+    mlkem::poly_to_msg_scalar(x, &a);
+    mlkem::poly_to_msg_avx2(y, &a);
+    if (memcmp(x, y, sizeof(x))) { return false; }
+    mlkem::msg_to_poly_scalar(&b, x);
+    mlkem::msg_to_poly_avx2(&c, x);
+    if (memcmp(&b, &c, sizeof(b))) { return false; }
+  }
+  return true;
+}
+
+#endif
+
+#if MLKEM_HAS_BMI2
+
+static bool check_permute(int rounds) {
+  uint64_t x[25], y[25];
+  for (int i = 0; i < rounds; ++i) {
+    fill((uint8_t*)x, sizeof(x));
+    memcpy(y, x, sizeof(x));
+    sha::keccakf1600_state_permute_scalar(x);
+    sha::keccakf1600_state_permute_bmi2(y);
+    if (memcmp(x, y, sizeof(x))) { return false; }
+  }
+  return true;
+}
+
+#endif
+
+/* Every soa kernel, scalar and dispatched, against the poly kernels lane by
+ *   lane, on unreduced inputs as the ntt domain sees them */
+static bool check_soa(int rounds) {
+  static mlkem::poly_soa<16> a[4], b[4], x, y;
+  static mlkem::poly p[4][16], q[4][16], r, t;
+  for (int n = 0; n < rounds; ++n) {
+    for (int i = 0; i < 4; ++i) {
+      for (int l = 0; l < 16; ++l) {
+        fill_poly(&p[i][l]);
+        fill_poly(&q[i][l]);
+        mlkem::poly_soa_load(&a[i], l, &p[i][l]);
+        mlkem::poly_soa_load(&b[i], l, &q[i][l]);
+      }
+    }
+    x = a[0];
+    y = a[0];
+    mlkem::poly_soa_ntt(&x);
+    mlkem::poly_soa_ntt_scalar(&y);
+    for (int l = 0; l < 16; ++l) {
+      r = p[0][l];
+      mlkem::poly_ntt(&r);
+      mlkem::poly_soa_store(&t, &x, l);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+      mlkem::poly_soa_store(&t, &y, l);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+    }
+    mlkem::poly_soa_invntt(&x);
+    mlkem::poly_soa_invntt_scalar(&y);
+    mlkem::poly_soa_reduce(&x);
+    mlkem::poly_soa_reduce_scalar(&y);
+    for (int l = 0; l < 16; ++l) {
+      r = p[0][l];
+      mlkem::poly_ntt(&r);
+      mlkem::poly_invntt(&r);
+      mlkem::poly_reduce(&r);
+      mlkem::poly_soa_store(&t, &x, l);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+      mlkem::poly_soa_store(&t, &y, l);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+    }
+    mlkem::poly_soa_basemul_acc<4>(&x, a, b);
+    mlkem::poly_soa_basemul_acc_scalar<4>(&y, a, b);
+    for (int l = 0; l < 16; ++l) {
+      mlkem::poly_vec<mlkem::mlkem1024> u, v;
+      mlkem::soa_to_poly_vec(&u, a, l);
+      mlkem::soa_to_poly_vec(&v, b, l);
+      mlkem::poly_vec_mulcache<mlkem::mlkem1024> vc;
+      mlkem::poly_vec_mulcache_compute(&vc, &v);
+      mlkem::poly_vec_basemul(&r, &u, &v);
+      mlkem::poly_vec_basemul(&t, &u, &v, &vc);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+      mlkem::poly_soa_store(&t, &x, l);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+      mlkem::poly_soa_store(&t, &y, l);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+    }
+    mlkem::poly_vec<mlkem::mlkem1024> s;
+    mlkem::poly_vec_mulcache<mlkem::mlkem1024> sc;
+    mlkem::soa_to_poly_vec(&s, b, 0);
+    mlkem::poly_vec_mulcache_compute(&sc, &s);
+    mlkem::poly_soa_basemul_acc_shared<4>(&x, a, s.vec, sc.vec);
+    mlkem::poly_soa_basemul_acc_shared_scalar<4>(&y, a, s.vec, sc.vec);
+    for (int l = 0; l < 16; ++l) {
+      mlkem::poly_vec<mlkem::mlkem1024> u;
+      mlkem::soa_to_poly_vec(&u, a, l);
+      mlkem::poly_vec_basemul(&r, &u, &s, &sc);
+      mlkem::poly_soa_store(&t, &x, l);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+      mlkem::poly_soa_store(&t, &y, l);
+      if (memcmp(&r, &t, sizeof(r))) { return false; }
+    }
+  }
+  return true;
+}
+
+/* Sha3 known answer, and shake256 absorbed and squeezed in uneven pieces 
+ *   against the one shot path */
+static bool check_sponge() {
+  static const uint8_t abc[32] = {
+    0x3a, 0x98, 0x5d, 0xa7, 0x4f, 0xe2, 0x25, 0xb2, 0x04, 0x5c, 0x17, 0x2d, 0x6b, 0xd3, 0x90, 0xbd,
+    0x85, 0x5f, 0x08, 0x6e, 0x3e, 0x9d, 0x52, 0x5b, 0x46, 0xbf, 0xe2, 0x45, 0x11, 0x43, 0x15, 0x32
+  };
+  uint8_t in[1000], x[500], y[500];
+  sha::keccak_ctx ctx;
+  size_t n;
+  sha::sha3_256(x, (const uint8_t*)"abc", 3);
+  if (memcmp(x, abc, 32)) { return false; }
+  fill(in, sizeof(in));
+  for (size_t len = 0; len < sizeof(in); len += 37) {
+    sha::shake256(x, sizeof(x), in, len);
+    sha::shake256_init(&ctx);
+    for (size_t i = 0; i < len; i += n) {
+      n = (len - i < 1 + i % 13) ? len - i : 1 + i % 13;
+      sha::shake256_absorb(&ctx, in + i, n);
+    }
+    sha::shake256_finalize(&ctx);
+    for (size_t i = 0; i < sizeof(y); i += n) {
+      n = (sizeof(y) - i < 1 + i % 11) ? sizeof(y) - i : 1 + i % 11;
+      sha::shake256_squeeze(y + i, n, &ctx);
+    }
+    if (memcmp(x, y, sizeof(x))) { return false; }
+  }
+  return true;
+}
+
+/* Rejection prf of four distinct ciphers against the single state one
+ * */
+template <typename P>
+static bool check_rkprf_x4() {
+  static uint8_t key[mlkem::seed_len], c[4][P::cipher_len], x[4][32], y[32];
+  uint8_t* out[4] = { x[0], x[1], x[2], x[3] };
+  const uint8_t* in[4] = { c[0], c[1], c[2], c[3] };
+  fill(key, sizeof(key));
+  fill(&c[0][0], sizeof(c));
+  mlkem::shake256_rkprf_x4<P>(out, key, in);
+  for (int l = 0; l < 4; ++l) {
+    mlkem::shake256_rkprf<P>(y, key, c[l]);
+    if (memcmp(x[l], y, sizeof(y))) { return false; }
+  }
+  return true;
+}
+
+/* Each lane of the 4-way keccak and of the sponges built on it against the
+ *   single state functions, the four lanes always get distinct inputs */
+static bool check_sponge_x4() {
+  constexpr size_t nblocks = 3;
+  static uint8_t in[4][600], x[4][nblocks * sha::shake128_rate], y[nblocks * sha::shake128_rate];
+  alignas(32) uint64_t s4[100], t4[100];
+  uint64_t s[25];
+  sha::keccakx4_ctx ctx;
+  uint8_t* out[4] = { x[0], x[1], x[2], x[3] };
+  const uint8_t* key[4] = { in[0], in[1], in[2], in[3] };
+  const uint8_t nonce[4] = { 0, 1, 2, 0xff };
+
+  fill((uint8_t*)s4, sizeof(s4));
+  for (int n = 0; n < 3; ++n) {
+    memcpy(t4, s4, sizeof(t4));
+    sha::keccakx4_permute(s4);
+    for (int l = 0; l < 4; ++l) {
+      for (int i = 0; i < 25; ++i) { s[i] = t4[4 * i + l]; }
+      sha::keccakf1600_state_permute_scalar(s);
+      for (int i = 0; i < 25; ++i) {
+        if (s[i] != s4[4 * i + l]) { return false; }
+      }
+    }
+    sha::keccakx4_permute_scalar(t4);
+    if (memcmp(s4, t4, sizeof(t4))) { return false; }
+  }
+
+  fill(&in[0][0], sizeof(in));
+  for (size_t len = 0; len < sizeof(in[0]); len += 29) {
+    sha::shake128x4_absorb_once(&ctx, in[0], in[1], in[2], in[3], len);
+    sha::shake128x4_squeeze_blocks(x[0], x[1], x[2], x[3], nblocks, &ctx);
+    for (int l = 0; l < 4; ++l) {
+      sha::shake128(y, nblocks * sha::shake128_rate, in[l], len);
+      if (memcmp(x[l], y, nblocks * sha::shake128_rate)) { return false; }
+    }
+    sha::shake256x4_absorb_once(&ctx, in[0], in[1], in[2], in[3], len);
+    sha::shake256x4_squeeze_blocks(x[0], x[1], x[2], x[3], nblocks, &ctx);
+    for (int l = 0; l < 4; ++l) {
+      sha::shake256(y, nblocks * sha::shake256_rate, in[l], len);
+      if (memcmp(x[l], y, nblocks * sha::shake256_rate)) { return false; }
+    }
+    sha::sha3_512x4(x[0], x[1], x[2], x[3], in[0], in[1], in[2], in[3], len);
+    for (int l = 0; l < 4; ++l) {
+      sha::sha3_512(y, in[l], len);
+      if (memcmp(x[l], y, 64)) { return false; }
+    }
+  }
+
+  mlkem::shake256x4_prf(out, nblocks, key, nonce);
+  for (int l = 0; l < 4; ++l) {
+    mlkem::shake256_prf(y, nblocks * sha::shake256_rate, key[l], nonce[l]);
+    if (memcmp(x[l], y, nblocks * sha::shake256_rate)) { return false; }
+  }
+  return check_rkprf_x4<mlkem::mlkem512>() && check_rkprf_x4<mlkem::mlkem768>() 
+    && check_rkprf_x4<mlkem::mlkem1024>();
+}
+
+/* Differential check of the avx2 and bmi2 kernels against the scalar code
+ *   before timing them */
+static bool check_kernels() {
+  constexpr int rounds = 2000;
+  bool ok = check_sponge() && check_sponge_x4() && check_soa(20);
+#if MLKEM_HAS_AVX2
+  if (mlkem::cpu_has_avx2()) {
+    ok = ok && check_ntt(rounds) && check_rej(rounds) && check_cbd(rounds)
+      && check_compress<4>(rounds) && check_compress<5>(rounds) && check_compress<10>(rounds)
+      && check_compress<11>(rounds) && check_msg(rounds);
+  }
+#endif
+#if MLKEM_HAS_BMI2
+  if (mlkem::cpu_has_bmi2()) { ok = ok && check_permute(rounds); }
+#endif
+  printf("simd vs scalar: %s\n", ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+template <typename P>
+static void per_set(const std::string& set) {
+  static mlkem::poly_vec<P> a[P::mlkem_k], v;
+  static mlkem::poly_vec_mulcache<P> vc;
+  static mlkem::poly p;
+  static uint8_t seed[mlkem::seed_len], out[32];
+  static uint8_t ek[P::ek_len], dk[P::dk_len], c[P::cipher_len], ss[32];
+  static mlkem::expanded_ek<P> eek;
+  static mlkem::expanded_dk<P> edk;
+  fill(seed, sizeof(seed));
+  for (int i = 0; i < P::mlkem_k; ++i) { fill_poly(&v.vec[i]); }
+  fill_poly(&p);
+
+  run("gen_matrix", set, [&] { mlkem::gen_matrix(a, seed, 0); bench::escape(a); });
+  run("poly_compress", set, [&] { mlkem::poly_compress<P::mlkem_dv>(c, &p); bench::escape(c); });
+  run("poly_compress_scalar", set, [&] { mlkem::poly_compress_scalar<P::mlkem_dv>(c, &p); bench::escape(c); });
+  run("poly_decompress", set, [&] { mlkem::poly_decompress<P::mlkem_dv>(&p, c); bench::escape(&p); });
+  run("poly_decompress_scalar", set, [&] { mlkem::poly_decompress_scalar<P::mlkem_dv>(&p, c); bench::escape(&p); });
+  run("poly_vec_compress", set, [&] { mlkem::poly_vec_compress(c, &v); bench::escape(c); });
+  run("poly_vec_decompress", set, [&] { mlkem::poly_vec_decompress(&v, c); bench::escape(&v); });
+  run("poly_vec_basemul", set, [&] { mlkem::poly_vec_basemul(&p, &a[0], &v); bench::escape(&p); });
+  mlkem::poly_vec_mulcache_compute(&vc, &v);
+  run("poly_vec_basemul(mulcache)", set, [&] { mlkem::poly_vec_basemul(&p, &a[0], &v, &vc); bench::escape(&p); });
+
+  mlkem::key_gen<P>(ek, dk);
+  run("sha3_256(ek)", set, [&] { sha::sha3_256(out, ek, P::ek_len); bench::escape(out); });
+  run("shake256_rkprf", set, [&] { mlkem::shake256_rkprf<P>(out, seed, c); bench::escape(out); });
+  run("key_gen", set, [&] { mlkem::key_gen<P>(ek, dk); bench::escape(dk); });
+  run("encap", set, [&] { mlkem::encap<P>(c, ss, ek); bench::escape(ss); });
+  run("decap", set, [&] { mlkem::decap<P>(ss, c, dk); bench::escape(ss); });
+  mlkem::expand_ek(&eek, ek);
+  mlkem::expand_dk(&edk, dk);
+  run("encap(expanded_ek)", set, [&] { mlkem::encap(c, ss, &eek); bench::escape(ss); });
+  run("decap(expanded_dk)", set, [&] { mlkem::decap(ss, c, &edk); bench::escape(ss); });
+}
+
+/* Barrett reduced coefficients per op with a reduction after every ntt and
+ *   in every invntt layer, the schedule before reductions were made lazy */
+template <typename P>
+static constexpr uint64_t eager_reductions(const char* op) {
+  constexpr uint64_t k = P::mlkem_k, n = mlkem::mlkem_n;
+  constexpr uint64_t enc = k * n + (k + 1) * n + (k + 1) * 7 * n / 2 + (k + 1) * n;
+  constexpr uint64_t dec = k * n + n + 7 * n / 2 + n;
+  return op[0] == 'k' ? 4 * k * n : op[0] == 'e' ? enc : dec + enc;
+}
+
+/* Stage breakdown of each operation, only with MLKEM_STAGE_PROFILE
+ * */
+template <typename P, typename F>
+static void stages(const char* op, const std::string& set, F&& f) {
+  constexpr int iters = 200;
+  mlkem::stage_counters c;
+  f();
+  mlkem::stage_reset();
+  for (int i = 0; i < iters; ++i) { f(); }
+  mlkem::stage_snapshot(&c);
+  printf("%-8s %-5s", op, set.c_str());
+  for (int s = 0; s < mlkem::stage_count; ++s) {
+    if (c.calls[s]) { printf("  %s %.0f", mlkem::stage_name((mlkem::stage)s), (double)c.cycles[s] / iters); }
+  }
+  printf("  barrett %llu (eager %llu)\n", (unsigned long long)(c.reductions / iters),
+    (unsigned long long)eager_reductions<P>(op));
+}
+
+template <typename P>
+static void stages_of(const std::string& set) {
+  static uint8_t ek[P::ek_len], dk[P::dk_len], c[P::cipher_len], ss[32];
+  mlkem::key_gen<P>(ek, dk);
+  stages<P>("key_gen", set, [&] { mlkem::key_gen<P>(ek, dk); });
+  stages<P>("encap", set, [&] { mlkem::encap<P>(c, ss, ek); });
+  stages<P>("decap", set, [&] { mlkem::decap<P>(ss, c, dk); });
+}
+
+int main(int argc, char* argv[]) {
+  const char* json = nullptr;
+  bool check_only = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+      json = argv[++i];
+    } else if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+      samples = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (!strcmp(argv[i], "--check")) {
+      check_only = true;
+    } else {
+      fprintf(stderr, "usage: %s [--json FILE] [--samples N] [--filter SUBSTR] [--check]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (samples < 1) { samples = 1; }
+
+  std::string cpu = mlkem::cpu_has_avx2() ? "avx2" : "scalar";
+  printf("cpu kernels: %s\n", cpu.c_str());
+  if (!check_kernels()) { return 1; }
+  if (check_only) { return 0; }
+  bench::print_header();
+  kernels();
+  per_set<mlkem::mlkem512>("512");
+  per_set<mlkem::mlkem768>("768");
+  per_set<mlkem::mlkem1024>("1024");
+
+  if (mlkem::stage_profile_enabled && !filter) {
+    printf("\ncycles per op spent in each stage (stages nest), barrett reduced coefficients per op\n");
+    stages_of<mlkem::mlkem512>("512");
+    stages_of<mlkem::mlkem768>("768");
+    stages_of<mlkem::mlkem1024>("1024");
+  }
+
+  if (json && !bench::write_json(json, results, cpu)) {
+    fprintf(stderr, "cannot write %s\n", json);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+/* Copyright 2026 (c), Yao Zeran, Zhang Chenzhi
+ *
+ * Peak stack of key gen, encap and decap for every parameter set, with and 
+ *   without a workspace, each operation runs on its own painted stack and the
+ *   deepest overwritten byte gives its peak, exits 1 if a workspace overload
+ *   exceeds workspace_stack_bound, and 77 (skipped under ctest) without 
+ *   checking on a build MLKEM_STACK_BOUND_HOLDS excludes. */
+
+#include <cstdio>
+#include <cstring>
+#include <ucontext.h>
+
+#include "../src/fips/include.h"
+
+static constexpr size_t stack_size = 1 << 20;
+static constexpr unsigned char paint = 0xa5;
+
+static unsigned char stack[stack_size];
+static ucontext_t caller, callee;
+static void (*op)();
+
+static void trampoline() { op(); }
+
+/* Bytes of the painted stack f touched, the stack grows down from the top */
+static size_t peak_stack(void (*f)()) {
+  size_t used;
+  memset(stack, paint, stack_size);
+  op = f;
+  getcontext(&callee);
+  callee.uc_stack.ss_sp = stack;
+  callee.uc_stack.ss_size = stack_size;
+  callee.uc_link = &caller;
+  makecontext(&callee, trampoline, 0);
+  swapcontext(&caller, &callee);
+  for (used = stack_size; used > 0 && stack[stack_size - used] == paint; --used) {}
+  return used;
+}
+
+template <typename P>
+struct keys {
+  static inline uint8_t ek[P::ek_len], dk[P::dk_len], c[P::cipher_len], ss[32];
+  static inline mlkem::workspace ws;
+};
+
+template <typename P>
+static bool check(const char* set) {
+  using K = keys<P>;
+  constexpr mlkem::stack_bound b = mlkem::workspace_stack_bound<P>;
+  size_t kg, en, de, kgw, enw, dew;
+  mlkem::key_gen<P>(K::ek, K::dk); /* warm up the cpu and rand state */
+  kg = peak_stack([] { mlkem::key_gen<P>(K::ek, K::dk); });
+  kgw = peak_stack([] { mlkem::key_gen<P>(K::ek, K::dk, &K::ws); });
+  en = peak_stack([] { mlkem::encap<P>(K::c, K::ss, K::ek); });
+  enw = peak_stack([] { mlkem::encap<P>(K::c, K::ss, K::ek, &K::ws); });
+  de = peak_stack([] { mlkem::decap<P>(K::ss, K::c, K::dk); });
+  dew = peak_stack([] { mlkem::decap<P>(K::ss, K::c, K::dk, &K::ws); });
+  printf("%-5s %8zu %8zu %8zu   %8zu %8zu %8zu   %8zu %8zu %8zu\n", set, kg, en, de, kgw, enw, dew, 
+    b.key_gen, b.encap, b.decap);
+  return kgw <= b.key_gen && enw <= b.encap && dew <= b.decap;
+}
+
+int main() {
+  bool ok = true;
+  printf("peak stack bytes, workspace size %zu\n", sizeof(mlkem::workspace));
+  printf("%-5s %8s %8s %8s   %8s %8s %8s   %8s %8s %8s\n", "set", "key_gen", "encap", "decap", 
+    "ws kg", "ws enc", "ws dec", "bound kg", "enc", "dec");
+  ok = check<mlkem::mlkem512>("512") && ok;
+  ok = check<mlkem::mlkem768>("768") && ok;
+  ok = check<mlkem::mlkem1024>("1024") && ok;
+  if (!MLKEM_STACK_BOUND_HOLDS) {
+    printf("bound not measured for this build, not checked\n");
+    return 77;
+  }
+  printf("%s\n", ok ? "ok" : "EXCEEDS BOUND");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+/* Copyright 2026, Yao Zeran, Zhang Chenzhi
+ *
+ * The <async.h> file defines coroutine versions of key gen, encap and decap
+ *   that give the thread back at the stage boundaries (matrix expansion, noise
+ *   sampling, ntt products, hash steps, fo re-encryption), so one event loop
+ *   can keep many handshakes in flight without any of them holding it for a
+ *   whole operation. */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <utility>
+#include <exception>
+#include <coroutine>
+
+#include "common.h"
+#include "mlkem.h"
+
+namespace mlkem
+{
+
+/* Anything that can queue a coroutine to be resumed later, the async api only
+ *   posts to it and never resumes on its own, so the executor decides where
+ *   and when each stage runs */
+template <typename E>
+concept executor = requires(E& ex, std::coroutine_handle<> h) { ex.post(h); };
+
+/* Lazy coroutine returning T, started by co_await on it or by spawn, resumes
+ *   the awaiting coroutine directly when done
+ * */
+template <typename T>
+class task {
+public:
+  struct promise_type {
+    T value{};
+    std::coroutine_handle<> next = std::noop_coroutine();
+
+    struct final_awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        return h.promise().next;
+      }
+      void await_resume() noexcept {}
+    };
+
+    task get_return_object() noexcept { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    final_awaiter final_suspend() noexcept { return {}; }
+    void return_value(T v) noexcept { value = std::move(v); }
+    void unhandled_exception() noexcept { std::terminate(); } /* nothing in the kem throws */
+  };
+
+  task(task&& t) noexcept : h_(std::exchange(t.h_, {})) {}
+  task(const task&) = delete;
+  task& operator=(const task&) = delete;
+  ~task() { if (h_) { h_.destroy(); } }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    h_.promise().next = awaiting;
+    return h_;
+  }
+  T await_resume() noexcept { return std::move(h_.promise().value); }
+
+private:
+  explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+  std::coroutine_handle<promise_type> h_;
+};
+
+/* co_await next_stage(ex) posts the current coroutine to ex and suspends, it
+ *   carries on when the executor resumes it */
+template <executor E>
+struct next_stage {
+  E& ex;
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h) { ex.post(h); }
+  void await_resume() const noexcept {}
+};
+
+template <executor E>
+next_stage(E&) -> next_stage<E>;
+
+/* Reference executor, a fifo run queue drained by the thread that calls run,
+ *   a stage yielding goes to the back so in-flight operations take turns
+ * */
+class loop_executor {
+public:
+  void post(std::coroutine_handle<> h) { q_.push_back(h); }
+
+  bool empty() const { return q_.empty(); }
+
+  /* Resume the oldest queued coroutine, false if there was none */
+  bool run_one() {
+    if (q_.empty()) { return false; }
+    std::coroutine_handle<> h = q_.front();
+    q_.pop_front();
+    h.resume();
+    return true;
+  }
+
+  void run() { while (run_one()) {} }
+
+private:
+  std::deque<std::coroutine_handle<>> q_;
+};
+
+struct detached {
+  struct promise_type {
+    detached get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+/* Start t on ex without waiting for it, done(result) runs on the executor
+ *   after the last stage, spawn itself returns before the first stage runs */
+template <executor E, typename T, typename F>
+inline detached spawn(E& ex, task<T> t, F done) {
+  co_await next_stage(ex);
+  done(co_await t);
+}
+
+/* Async key gen, encap and decap, same results as the sync api and same
+ *   return values (0, or -1 for an unknown parameter set)
+ *
+ *   ws holds the state carried between stages, so unlike the sync workspace
+ *   overloads each operation in flight needs its own workspace until it is
+ *   done, the coroutine frame keeps only the seeds and hashes, all buffers
+ *   belong to the caller and must outlive the operation */
+
+template <typename P, executor E>
+inline task<int> async_key_gen(E& ex, uint8_t* ek, uint8_t* dk, workspace* ws) {
+  key_gen_work<P>* w = &work_of<P>(ws)->key_gen;
+  uint8_t seeds[2 * seed_len];
+
+  gen_rand_bytes(seeds, 2 * seed_len);
+  indcpa_key_gen_seeds(w, seeds);
+  if constexpr (!stream_matrix) {
+    co_await next_stage(ex);
+    indcpa_key_gen_matrix(w);
+  }
+  co_await next_stage(ex);
+  indcpa_key_gen_noise(w);
+  co_await next_stage(ex);
+  indcpa_key_gen_products(ek, dk, w);
+
+  co_await next_stage(ex);
+  memcpy(dk + P::poly_vec_len, ek, P::ek_len); /* same layout as key_gen */
+  {
+    MLKEM_STAGE(hash_h);
+    sha::sha3_256(dk + P::poly_vec_len + P::ek_len, ek, P::ek_len);
+  }
+  memcpy(dk + P::poly_vec_len + P::ek_len + sha::hash256_len, seeds + seed_len, seed_len);
+  co_return 0;
+}
+
+/* Helper: fo encryption stages shared by encap and the re-encryption in decap
+ * */
+template <typename P, executor E>
+static inline task<int> async_indcpa_enc(E& ex, uint8_t* c, const uint8_t* m,
+  const expanded_ek<P>* eek, const uint8_t* seed, enc_work<P>* w) {
+  indcpa_enc_noise(w, m, seed);
+  co_await next_stage(ex);
+  indcpa_enc_products(w, eek);
+  co_await next_stage(ex);
+  indcpa_enc_pack(c, w);
+  co_return 0;
+}
+
+template <typename P, executor E>
+static inline task<int> async_encap(E& ex, uint8_t* cipher, uint8_t* sk, const expanded_ek<P>* ek, enc_work<P>* w) {
+  uint8_t buf[seed_len + sha::hash256_len];
+  uint8_t kr[64];
+
+  gen_rand_bytes(buf, seed_len);
+  memcpy(buf + seed_len, ek->hek, sha::hash256_len);
+  {
+    MLKEM_STAGE(hash_g);
+    sha::sha3_512(kr, buf, seed_len + sha::hash256_len);
+  }
+  co_await next_stage(ex);
+  co_await async_indcpa_enc(ex, cipher, buf, ek, kr + seed_len, w);
+
+  memcpy(sk, kr, seed_len);
+  co_return 0;
+}
+
+template <typename P, executor E>
+inline task<int> async_encap(E& ex, uint8_t* cipher, uint8_t* sk, const expanded_ek<P>* ek, workspace* ws) {
+  return async_encap(ex, cipher, sk, ek, &work_of<P>(ws)->enc);
+}
+
+/* The expanded ek goes to ws, the matrix expansion is a stage of its own */
+template <typename P, executor E>
+inline task<int> async_encap(E& ex, uint8_t* cipher, uint8_t* sk, const uint8_t* ek, workspace* ws) {
+  kem_work<P>* w = work_of<P>(ws);
+  expand_ek(&w->dk.ek, ek);
+  co_await next_stage(ex);
+  co_return co_await async_encap(ex, cipher, sk, &w->dk.ek, &w->enc);
+}
+
+template <typename P, executor E>
+static inline task<int> async_decap(E& ex, uint8_t* ss, const uint8_t* cipher, const expanded_dk<P>* dk, decap_work<P>* w) {
+  uint8_t buf[msg_len + sha::hash256_len];
+  uint8_t kr[msg_len + seed_len];
+
+  indcpa_dec(buf, cipher, &dk->s, &dk->sc, &w->dec);
+  co_await next_stage(ex);
+
+  memcpy(buf + msg_len, dk->ek.hek, sha::hash256_len);
+  {
+    MLKEM_STAGE(hash_g);
+    sha::sha3_512(kr, buf, msg_len + sha::hash256_len);
+  }
+  co_await next_stage(ex);
+  co_await async_indcpa_enc(ex, w->cmp, buf, &dk->ek, kr + msg_len, &w->enc);
+  co_await next_stage(ex);
+
+  decap_select(ss, cipher, w->cmp, dk, kr);
+  co_return 0;
+}
+
+template <typename P, executor E>
+inline task<int> async_decap(E& ex, uint8_t* ss, const uint8_t* cipher, const expanded_dk<P>* dk, workspace* ws) {
+  return async_decap(ex, ss, cipher, dk, &work_of<P>(ws)->decap);
+}
+
+template <typename P, executor E>
+inline task<int> async_decap(E& ex, uint8_t* ss, const uint8_t* cipher, const uint8_t* dk, workspace* ws) {
+  kem_work<P>* w = work_of<P>(ws);
+  expand_dk(&w->dk, dk);
+  co_await next_stage(ex);
+  co_return co_await async_decap(ex, ss, cipher, &w->dk, &w->decap);
+}
+
+/* Runtime api, as with_params but each case awaits its own instantiation */
+
+template <executor E>
+inline task<int> async_key_gen(E& ex, param_set set, uint8_t* ek, uint8_t* dk, workspace* ws) {
+  switch (set) {
+    case param_set::mlkem512: co_return co_await async_key_gen<mlkem512>(ex, ek, dk, ws);
+    case param_set::mlkem768: co_return co_await async_key_gen<mlkem768>(ex, ek, dk, ws);
+    case param_set::mlkem1024: co_return co_await async_key_gen<mlkem1024>(ex, ek, dk, ws);
+  }
+  co_return -1;
+}
+
+template <executor E>
+inline task<int> async_encap(E& ex, param_set set, uint8_t* cipher, uint8_t* ss, const uint8_t* ek, workspace* ws) {
+  switch (set) {
+    case param_set::mlkem512: co_return co_await async_encap<mlkem512>(ex, cipher, ss, ek, ws);
+    case param_set::mlkem768: co_return co_await async_encap<mlkem768>(ex, cipher, ss, ek, ws);
+    case param_set::mlkem1024: co_return co_await async_encap<mlkem1024>(ex, cipher, ss, ek, ws);
+  }
+  co_return -1;
+}
+
+template <executor E>
+inline task<int> async_decap(E& ex, param_set set, uint8_t* ss, const uint8_t* cipher, const uint8_t* dk, workspace* ws) {
+  switch (set) {
+    case param_set::mlkem512: co_return co_await async_decap<mlkem512>(ex, ss, cipher, dk, ws);
+    case param_set::mlkem768: co_return co_await async_decap<mlkem768>(ex, ss, cipher, dk, ws);
+    case param_set::mlkem1024: co_return co_await async_decap<mlkem1024>(ex, ss, cipher, dk, ws);
+  }
+  co_return -1;
+}
+
+} /* namespace mlkem */
+
+#endif /* ASYNC_H */
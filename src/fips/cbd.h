@@ -6,7 +6,10 @@
 #ifndef CBD_H
 #define CBD_H
 
+#include <cstring>
+
 #include "common.h"
+#include "cpu.h"
 #include "poly.h"
 
 namespace mlkem
@@ -25,7 +28,7 @@ static uint32_t load24_le(const uint8_t bytes[3]) {
  *   for eta = 2, 
  *   for each coefficient, we need 4 bits as 
  *     coeff = sum_{i=1}^eta(a_i) - sum_{i=(eta+1)}^{2*eta}(a_i) */
-static inline void cbd2(poly* p, const uint8_t rand_bytes[4*mlkem_n/8]) {
+static inline void cbd2_scalar(poly* p, const uint8_t rand_bytes[4*mlkem_n/8]) {
   uint32_t t, d;
   int16_t a, b;
   for (int i = 0; i < mlkem_n / 8; ++i) {
@@ -46,7 +49,7 @@ static inline void cbd2(poly* p, const uint8_t rand_bytes[4*mlkem_n/8]) {
  *   for each coeff, we have
  *     coeff = (x_1 + x_2 + x_3) - (x_4 + x_5 + x_6) 
  *   so we need 6 * n / 8 bytes in total */
-static inline void cbd3(poly* p, const uint8_t rand_bytes[6*mlkem_n/8]) {
+static inline void cbd3_scalar(poly* p, const uint8_t rand_bytes[6*mlkem_n/8]) {
   uint32_t t, d;
   int16_t a, b;
   for(int i = 0; i < mlkem_n / 4; ++i) {
@@ -62,19 +65,138 @@ static inline void cbd3(poly* p, const uint8_t rand_bytes[6*mlkem_n/8]) {
   }
 }
 
-/* Central binomial distribution to generate small noise polynomial e
+#if MLKEM_HAS_AVX2
+
+/* Avx2 version of cbd2, 64 coefficients per 32 bytes, each nibble becomes
+ *   a + 3 - b in a byte, the bytes are split, centered and widened in order
  * */
-inline void cbd_eta1(poly* p, const uint8_t rand_bytes[mlkem_eta1*mlkem_n/4]) {
-  if (mlkem_eta1 == 2) {
-    cbd2(p, rand_bytes);
-  } else if (mlkem_eta1 == 3) {
-    cbd3(p, rand_bytes);
+MLKEM_TARGET_AVX2 static inline void cbd2_avx2(poly* p, const uint8_t rand_bytes[4*mlkem_n/8]) {
+  const __m256i mask55 = _mm256_set1_epi32(0x55555555);
+  const __m256i mask33 = _mm256_set1_epi32(0x33333333);
+  const __m256i mask03 = _mm256_set1_epi32(0x03030303);
+  const __m256i mask0f = _mm256_set1_epi32(0x0f0f0f0f);
+  __m256i f0, f1, f2, f3;
+  for (int i = 0; i < mlkem_n / 64; ++i) {
+    f0 = _mm256_loadu_si256((const __m256i*)(rand_bytes + 32 * i));
+
+    f1 = _mm256_srli_epi16(f0, 1);
+    f0 = _mm256_and_si256(mask55, f0);
+    f1 = _mm256_and_si256(mask55, f1);
+    f0 = _mm256_add_epi8(f0, f1); /* a and b of every coeff as 2 bit sums */
+
+    f1 = _mm256_srli_epi16(f0, 2);
+    f0 = _mm256_and_si256(mask33, f0);
+    f1 = _mm256_and_si256(mask33, f1);
+    f0 = _mm256_add_epi8(f0, mask33);
+    f0 = _mm256_sub_epi8(f0, f1); /* a + 3 - b per nibble */
+
+    f1 = _mm256_srli_epi16(f0, 4);
+    f0 = _mm256_and_si256(mask0f, f0);
+    f1 = _mm256_and_si256(mask0f, f1);
+    f0 = _mm256_sub_epi8(f0, mask03); /* coeffs 2j */
+    f1 = _mm256_sub_epi8(f1, mask03); /* coeffs 2j + 1 */
+
+    f2 = _mm256_unpacklo_epi8(f0, f1);
+    f3 = _mm256_unpackhi_epi8(f0, f1);
+
+    f0 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(f2));
+    f1 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(f3));
+    f2 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(f2, 1));
+    f3 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(f3, 1));
+
+    _mm256_storeu_si256((__m256i*)(p->coeffs + 64 * i + 0), f0);
+    _mm256_storeu_si256((__m256i*)(p->coeffs + 64 * i + 16), f1);
+    _mm256_storeu_si256((__m256i*)(p->coeffs + 64 * i + 32), f2);
+    _mm256_storeu_si256((__m256i*)(p->coeffs + 64 * i + 48), f3);
+  }
+}
+
+/* 32 coefficients of cbd3 from 24 bytes, reads 32 bytes from in, each 32 bit
+ *   lane gets 3 bytes, 4 coeffs of a + 3 - b at bits 0, 6, 12, 18 */
+MLKEM_TARGET_AVX2 static inline void cbd3_avx2_block(int16_t out[32], const uint8_t in[32]) {
+  const __m256i mask249 = _mm256_set1_epi32(0x249249);
+  const __m256i mask6db = _mm256_set1_epi32(0x6db6db);
+  const __m256i mask07 = _mm256_set1_epi32(7);
+  const __m256i mask70 = _mm256_set1_epi32(7 << 16);
+  const __m256i mask3 = _mm256_set1_epi16(3);
+  const __m256i idx = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+    4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+  __m256i f0, f1, f2, f3;
+
+  f0 = _mm256_loadu_si256((const __m256i*)in);
+  f0 = _mm256_permute4x64_epi64(f0, 0x94);
+  f0 = _mm256_shuffle_epi8(f0, idx);
+
+  f1 = _mm256_srli_epi32(f0, 1);
+  f2 = _mm256_srli_epi32(f0, 2);
+  f0 = _mm256_and_si256(mask249, f0);
+  f1 = _mm256_and_si256(mask249, f1);
+  f2 = _mm256_and_si256(mask249, f2);
+  f0 = _mm256_add_epi32(f0, f1);
+  f0 = _mm256_add_epi32(f0, f2); /* a and b of every coeff as 3 bit sums */
+
+  f1 = _mm256_srli_epi32(f0, 3);
+  f0 = _mm256_add_epi32(f0, mask6db);
+  f0 = _mm256_sub_epi32(f0, f1); /* a + 3 - b at bits 0, 6, 12, 18 */
+
+  f1 = _mm256_slli_epi32(f0, 10);
+  f2 = _mm256_srli_epi32(f0, 12);
+  f3 = _mm256_srli_epi32(f0, 2);
+  f0 = _mm256_and_si256(f0, mask07);
+  f1 = _mm256_and_si256(f1, mask70);
+  f2 = _mm256_and_si256(f2, mask07);
+  f3 = _mm256_and_si256(f3, mask70);
+  f0 = _mm256_add_epi16(f0, f1);
+  f1 = _mm256_add_epi16(f2, f3);
+  f0 = _mm256_sub_epi16(f0, mask3); /* coeffs 4j, 4j + 1 */
+  f1 = _mm256_sub_epi16(f1, mask3); /* coeffs 4j + 2, 4j + 3 */
+
+  f2 = _mm256_unpacklo_epi32(f0, f1);
+  f3 = _mm256_unpackhi_epi32(f0, f1);
+
+  _mm256_storeu_si256((__m256i*)(out + 0), _mm256_permute2x128_si256(f2, f3, 0x20));
+  _mm256_storeu_si256((__m256i*)(out + 16), _mm256_permute2x128_si256(f2, f3, 0x31));
+}
+
+/* Avx2 version of cbd3, the last block is copied out as its 32 byte load 
+ *   would run past the input */
+MLKEM_TARGET_AVX2 static inline void cbd3_avx2(poly* p, const uint8_t rand_bytes[6*mlkem_n/8]) {
+  uint8_t last[32] = {0};
+  for (int i = 0; i < mlkem_n / 32 - 1; ++i) {
+    cbd3_avx2_block(p->coeffs + 32 * i, rand_bytes + 24 * i);
   }
+  memcpy(last, rand_bytes + 24 * (mlkem_n / 32 - 1), 24);
+  cbd3_avx2_block(p->coeffs + mlkem_n - 32, last);
 }
 
-/* Central binomial distribution to generate small ephemeral noise polynomial 
+#endif /* MLKEM_HAS_AVX2 */
+
+static inline void cbd2(poly* p, const uint8_t rand_bytes[4*mlkem_n/8]) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { cbd2_avx2(p, rand_bytes); return; }
+#endif
+  cbd2_scalar(p, rand_bytes);
+}
+
+static inline void cbd3(poly* p, const uint8_t rand_bytes[6*mlkem_n/8]) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { cbd3_avx2(p, rand_bytes); return; }
+#endif
+  cbd3_scalar(p, rand_bytes);
+}
+
+/* Central binomial distribution with parameter eta, eta1 of the parameter set
+ *   gives the secret and noise e, eta2 gives the ephemeral noise
  * */
-inline void cbd_eta2(poly* p, const uint8_t rand_bytes[mlkem_eta2*mlkem_n/4]) { cbd2(p, rand_bytes); }
+template <int eta>
+inline void cbd_eta(poly* p, const uint8_t rand_bytes[eta*mlkem_n/4]) {
+  static_assert(eta == 2 || eta == 3, "unsupported cbd eta");
+  if constexpr (eta == 2) {
+    cbd2(p, rand_bytes);
+  } else {
+    cbd3(p, rand_bytes);
+  }
+}
 
 } /* namespace mlkem */
 
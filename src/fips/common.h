@@ -25,8 +25,6 @@ namespace sha
 namespace mlkem
 {
 
-constexpr int mlkem_config_set = 512;
-
 /* mlkem operates in ring R_q: Z_q^n*/
 constexpr int mlkem_q = 3329;
 
@@ -36,39 +34,60 @@ constexpr int mlkem_inverse_q = -3327;
 /* number of coefficients in a polynomial */
 constexpr int mlkem_n = 256;
 
-/* number of poly in a vector of polys */
-constexpr int mlkem_k = (mlkem_config_set == 512) ? 2 :
-                        (mlkem_config_set == 768) ? 3 : 
-                        (mlkem_config_set == 1024) ? 4 : -1;
+/* polynomial byte len: 12 bits/coefficient, 256 * 12 / 8 = 384 */
+constexpr int poly_len = 384;
 
-constexpr int mlkem_eta1 = (mlkem_config_set == 512) ? 3 : 
-                           (mlkem_config_set == 768) ? 2 : 
-                           (mlkem_config_set == 1024) ? 2 : -1;
+/* other lens */
 
-constexpr int mlkem_eta2 = 2;
+constexpr int seed_len = 32;
 
-/* polynomial byte len: 12 bits/coefficient, 256 * 12 / 8 = 384 */
-constexpr int poly_len = 384;
+constexpr int msg_len = 32;
 
-/* polynomial vector byte len */
-constexpr int poly_vec_len = mlkem_k * poly_len;
+/* The parameter sets of fips203 section 8, every len and kernel that depends 
+ *   on the security level is specialized on one of these at compile time */
+template <int set>
+struct params {
+  static_assert(set == 512 || set == 768 || set == 1024, "unknown mlkem parameter set");
 
-constexpr int compressed_poly_len = (mlkem_config_set == 512) ? 128 :
-                                    (mlkem_config_set == 768) ? 128 :
-                                    (mlkem_config_set == 1024) ? 160 : -1;
+  static constexpr int mlkem_set = set;
 
-constexpr int compressed_poly_vec_len = (mlkem_config_set == 512) ? mlkem_k * 320 : 
-                                        (mlkem_config_set == 768) ? mlkem_k * 320 :
-                                        (mlkem_config_set == 1024) ? mlkem_k * 352 : -1;
+  /* number of poly in a vector of polys */
+  static constexpr int mlkem_k = (set == 512) ? 2 : 
+                                 (set == 768) ? 3 : 4;
 
-/* other lens */
+  static constexpr int mlkem_eta1 = (set == 512) ? 3 : 2;
 
-constexpr int seed_len = 32;
+  static constexpr int mlkem_eta2 = 2;
 
-constexpr int msg_len = 32;
+  /* bits kept per coefficient when compressing u and v of a cipher */
+  static constexpr int mlkem_du = (set == 1024) ? 11 : 10;
+
+  static constexpr int mlkem_dv = (set == 1024) ? 5 : 4;
+
+  /* polynomial vector byte len */
+  static constexpr int poly_vec_len = mlkem_k * poly_len;
+
+  static constexpr int compressed_poly_len = mlkem_dv * mlkem_n / 8;
+
+  static constexpr int compressed_poly_vec_len = mlkem_k * mlkem_du * mlkem_n / 8;
+
+  static constexpr int cipher_len = compressed_poly_vec_len + compressed_poly_len;
+
+  static constexpr int ek_len = poly_vec_len + seed_len;
+
+  static constexpr int dk_len = poly_vec_len + poly_vec_len + seed_len + sha::hash256_len + seed_len;
+};
+
+typedef params<512> mlkem512;
+typedef params<768> mlkem768;
+typedef params<1024> mlkem1024;
 
-constexpr int ek_len = poly_vec_len + seed_len;
-constexpr int dk_len = poly_vec_len + poly_vec_len + seed_len + sha::hash256_len + seed_len;
+/* Parameter set chosen at runtime, see the runtime api in <mlkem.h> */
+enum class param_set : int {
+  mlkem512 = 512,
+  mlkem768 = 768,
+  mlkem1024 = 1024
+};
 
 } /* namepsace mlkem */
 
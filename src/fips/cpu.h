@@ -0,0 +1,63 @@
+/* Copyright 2026, Yao Zeran, Zhang Chenzhi
+ *
+ * The <cpu.h> file defines runtime cpu feature detection used to pick between
+ *   the scalar and simd kernels. */
+
+#ifndef CPU_H
+#define CPU_H
+
+/* avx2 and bmi2 kernels are compiled per function with a target attribute,
+ * so the library itself does not need -mavx2, define MLKEM_NO_SIMD to drop them */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(MLKEM_NO_SIMD)
+#define MLKEM_HAS_AVX2 1
+#define MLKEM_TARGET_AVX2 __attribute__((target("avx2")))
+#define MLKEM_HAS_BMI2 1
+#define MLKEM_TARGET_BMI2 __attribute__((target("bmi,bmi2")))
+#include <immintrin.h>
+#else
+#define MLKEM_HAS_AVX2 0
+#define MLKEM_TARGET_AVX2
+#define MLKEM_HAS_BMI2 0
+#define MLKEM_TARGET_BMI2
+#endif
+
+#if defined(__GNUC__)
+#define MLKEM_ALWAYS_INLINE __attribute__((always_inline))
+#else
+#define MLKEM_ALWAYS_INLINE
+#endif
+
+namespace mlkem
+{
+
+/* Check if the running cpu (and os) supports avx2, only queried once
+ * */
+inline bool cpu_has_avx2() {
+#if MLKEM_HAS_AVX2
+  static const bool r = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return r;
+#else
+  return false;
+#endif
+}
+
+/* Check if the running cpu supports bmi1 and bmi2 (andn, rorx), only queried
+ *   once */
+inline bool cpu_has_bmi2() {
+#if MLKEM_HAS_BMI2
+  static const bool r = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi") != 0 && __builtin_cpu_supports("bmi2") != 0;
+  }();
+  return r;
+#else
+  return false;
+#endif
+}
+
+} /* namespace mlkem */
+
+#endif /* CPU_H */
@@ -0,0 +1,173 @@
+/* Copyright 2026 (c), Yao Zeran, Zhang Chenzhi
+ *
+ * The <engine.h> file implements a multi-threaded engine that runs key gen,
+ *   encap and decap jobs on a work stealing thread pool. */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+#include "common.h"
+#include "mlkem.h"
+
+namespace mlkem
+{
+
+/* A pool of workers, each with its own job deque and workspace, so jobs do not
+ *   put the expanded keys and polys on the worker stack
+ *
+ *   a worker pops jobs from the back of its own deque and, when that is empty,
+ *   steals from the front of the others, jobs submitted from a worker go to
+ *   its own deque, jobs from other threads are spread round robin
+ *
+ *   all buffers passed to a job belong to the caller and must stay valid until
+ *   the future is ready or the callback has run */
+class engine {
+public:
+  typedef std::function<void(int)> callback;
+
+  explicit engine(unsigned int nthreads = std::thread::hardware_concurrency()) {
+    if (nthreads == 0) { nthreads = 1; }
+    for (unsigned int i = 0; i < nthreads; ++i) { workers_.emplace_back(new worker); }
+    for (unsigned int i = 0; i < nthreads; ++i) { workers_[i]->t = std::thread([this, i] { run(i); }); }
+  }
+
+  /* Runs every job already submitted, then joins the workers */
+  ~engine() {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& w : workers_) { w->t.join(); }
+  }
+
+  engine(const engine&) = delete;
+  engine& operator=(const engine&) = delete;
+
+  unsigned int size() const { return (unsigned int)workers_.size(); }
+
+  /* Each job returns 0 on success and -1 for an unknown parameter set */
+
+  std::future<int> key_gen(param_set set, uint8_t* ek, uint8_t* dk) {
+    return submit([=](workspace* ws) { return mlkem::key_gen(set, ek, dk, ws); });
+  }
+
+  std::future<int> encap(param_set set, uint8_t* cipher, uint8_t* ss, const uint8_t* ek) {
+    return submit([=](workspace* ws) { return mlkem::encap(set, cipher, ss, ek, ws); });
+  }
+
+  std::future<int> decap(param_set set, uint8_t* ss, const uint8_t* cipher, const uint8_t* dk) {
+    return submit([=](workspace* ws) { return mlkem::decap(set, ss, cipher, dk, ws); });
+  }
+
+  void key_gen(param_set set, uint8_t* ek, uint8_t* dk, callback done) {
+    submit([=](workspace* ws) { return mlkem::key_gen(set, ek, dk, ws); }, std::move(done));
+  }
+
+  void encap(param_set set, uint8_t* cipher, uint8_t* ss, const uint8_t* ek, callback done) {
+    submit([=](workspace* ws) { return mlkem::encap(set, cipher, ss, ek, ws); }, std::move(done));
+  }
+
+  void decap(param_set set, uint8_t* ss, const uint8_t* cipher, const uint8_t* dk, callback done) {
+    submit([=](workspace* ws) { return mlkem::decap(set, ss, cipher, dk, ws); }, std::move(done));
+  }
+
+private:
+  typedef std::function<void(workspace*)> job;
+
+  struct worker {
+    std::mutex m;
+    std::deque<job> q;
+    workspace scratch;
+    std::thread t;
+  };
+
+  template <typename F>
+  std::future<int> submit(F f) {
+    auto pr = std::make_shared<std::promise<int>>();
+    std::future<int> fut = pr->get_future();
+    push([pr, f](workspace* s) { pr->set_value(f(s)); });
+    return fut;
+  }
+
+  template <typename F>
+  void submit(F f, callback done) {
+    push([f, done](workspace* s) { done(f(s)); });
+  }
+
+  /* The job is counted before it is queued, a worker can only take it after
+   *   that, so pending_ never drops below the jobs left in the deques */
+  void push(job j) {
+    size_t i = (self_ == this) ? index_ : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      ++pending_;
+    }
+    {
+      std::lock_guard<std::mutex> lk(workers_[i]->m);
+      workers_[i]->q.push_back(std::move(j));
+    }
+    cv_.notify_one();
+  }
+
+  /* Take the newest job of worker i, or the oldest job of another worker */
+  bool take(size_t i, job& j) {
+    for (size_t n = 0; n < workers_.size(); ++n) {
+      worker& w = *workers_[(i + n) % workers_.size()];
+      std::lock_guard<std::mutex> lk(w.m);
+      if (w.q.empty()) { continue; }
+      if (n == 0) {
+        j = std::move(w.q.back());
+        w.q.pop_back();
+      } else {
+        j = std::move(w.q.front());
+        w.q.pop_front();
+      }
+      pending_.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+
+  void run(size_t i) {
+    self_ = this;
+    index_ = i;
+    job j;
+    for (;;) {
+      if (take(i, j)) {
+        j(&workers_[i]->scratch);
+        j = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lk(m_);
+      cv_.wait(lk, [this] { return stop_ || pending_.load() > 0; });
+      if (stop_ && pending_.load() == 0) { return; }
+    }
+  }
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::atomic<size_t> pending_{0};
+  std::atomic<size_t> next_{0};
+  bool stop_ = false;
+
+  inline static thread_local engine* self_ = nullptr;
+  inline static thread_local size_t index_ = 0;
+};
+
+} /* namespace mlkem */
+
+#endif /* ENGINE_H */
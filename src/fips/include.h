@@ -6,13 +6,17 @@
 #define INCLUDE_H
 
 #include "common.h"
+#include "prof.h"
 
 #include "shake.h"
 
 #include "rand.h"
 #include "poly.h"
 #include "opt.h"
+#include "soa.h"
 #include "cbd.h"
 #include "mlkem.h"
+#include "engine.h"
+#include "async.h"
 
 #endif /* INCLUDE_H */
\ No newline at end of file
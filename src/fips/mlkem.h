@@ -5,30 +5,37 @@
 #ifndef MLKEM_H
 #define MLKEM_H
 
+#include <new>
 #include <string>
 #include <iostream>
 
 #include "poly.h"
+#include "soa.h"
 #include "rand.h"
+#include "prof.h"
 
 namespace mlkem
 {
 
-static inline void pack_ek(uint8_t ek[poly_vec_len + seed_len], poly_vec* ekpv, const uint8_t seed[seed_len]) {
+template <typename P>
+static inline void pack_ek(uint8_t ek[P::ek_len], poly_vec<P>* ekpv, const uint8_t seed[seed_len]) {
   poly_vec_to_bytes(ekpv, ek);
-  memcpy(ek + poly_vec_len, seed, seed_len);
+  memcpy(ek + P::poly_vec_len, seed, seed_len);
 }
 
-static inline void unpack_ek(poly_vec* ekpv, uint8_t seed[seed_len], const uint8_t ek[poly_vec_len + seed_len]) {
+template <typename P>
+static inline void unpack_ek(poly_vec<P>* ekpv, uint8_t seed[seed_len], const uint8_t ek[P::ek_len]) {
   bytes_to_poly_vec(ek, ekpv);
-  memcpy(seed, ek + poly_vec_len, seed_len);
+  memcpy(seed, ek + P::poly_vec_len, seed_len);
 }
 
-static inline void pack_dk(uint8_t dk[poly_vec_len], const poly_vec* dkpv) { 
+template <typename P>
+static inline void pack_dk(uint8_t dk[P::poly_vec_len], const poly_vec<P>* dkpv) { 
   poly_vec_to_bytes(dkpv, dk); 
 }
 
-static inline void unpack_dk(poly_vec* dkpv, const uint8_t dk[poly_vec_len]) { 
+template <typename P>
+static inline void unpack_dk(poly_vec<P>* dkpv, const uint8_t dk[P::poly_vec_len]) { 
   bytes_to_poly_vec(dk, dkpv); 
 }
 
@@ -37,112 +44,289 @@ static inline void unpack_dk(poly_vec* dkpv, const uint8_t dk[poly_vec_len]) {
  * and a poly v:
  *   v = t^Ty + e_2 + mu */
 
-static inline void pack_cipher(uint8_t c[compressed_poly_vec_len + compressed_poly_len], 
-    const poly_vec* u, const poly* v) {
+template <typename P>
+static inline void pack_cipher(uint8_t c[P::cipher_len], const poly_vec<P>* u, const poly* v) {
   poly_vec_compress(c, u);
-  poly_compress(c + compressed_poly_vec_len, v);
+  poly_compress<P::mlkem_dv>(c + P::compressed_poly_vec_len, v);
 }
 
-static inline void unpack_cipher(poly_vec* u, poly* v, 
-  const uint8_t c[compressed_poly_vec_len + compressed_poly_len]) {
+template <typename P>
+static inline void unpack_cipher(poly_vec<P>* u, poly* v, const uint8_t c[P::cipher_len]) {
   poly_vec_decompress(u, c);
-  poly_decompress(v, c + compressed_poly_vec_len);
+  poly_decompress<P::mlkem_dv>(v, c + P::compressed_poly_vec_len);
 }
 
 /* Helper: generate key pairs given two random seeds
  * 
  *   ek: the encapsulation key (pub key) that sender will use to encap 
  *   dk: the decapsulation key (pri key) that receiver will use to decap */
-static inline void indcpa_key_gen(uint8_t ek[poly_vec_len + seed_len], 
-    uint8_t dk[poly_vec_len], const uint8_t seeds[seed_len]) {
+template <typename P>
+struct key_gen_work {
+  poly_vec<P> a[stream_matrix ? 1 : P::mlkem_k]; /* with a streamed matrix a[0] takes each row in turn */
+  poly_vec<P> e, ekpv, dkpv;
+  poly_vec_mulcache<P> dkc; /* cache of s, used against every row of A */
+  uint8_t seeds[2 * seed_len]; /* public seed then noise seed */
+};
+
+/* Stages of indcpa_key_gen, each leaves its result in w for the next one, 
+ *   async.h yields between them */
+
+template <typename P>
+static inline void indcpa_key_gen_seeds(key_gen_work<P>* w, const uint8_t seeds[seed_len]) {
+  memcpy(w->seeds, seeds, seed_len);
+  w->seeds[seed_len] = P::mlkem_k;
+  MLKEM_STAGE(hash_g);
+  sha::sha3_512(w->seeds, w->seeds, seed_len + 1); /* expand 32+1 bytes to two pseudorandom 32-byte seeds */
+}
 
-  uint8_t buf[2 * seed_len]; /* used to store seeds */
-  const uint8_t* pub_seed = buf;
-  const uint8_t* noise_seed = buf + seed_len;
+template <typename P>
+static inline void indcpa_key_gen_matrix(key_gen_work<P>* w) {
+  if constexpr (!stream_matrix) { gen_matrix(w->a, w->seeds, 0); }
+}
 
-  memcpy(buf, seeds, seed_len);
-  buf[seed_len] = mlkem_k;
-  sha::sha3_512(buf, buf, seed_len + 1); /* expand 32+1 bytes to two pseudorandom 32-byte seeds */
-  
+template <typename P>
+static inline void indcpa_key_gen_noise(key_gen_work<P>* w) {
+  const uint8_t* noise_seed = w->seeds + seed_len;
   uint8_t nonce = 0;
-  poly_vec a[mlkem_k], e, ekpv, dkpv, b;
-
-  /* the process of calculating 
-   *   t = As + e 
-   * where A is a random matrix, t is ek, e is noise, s is dk 
-   * specified as noisy linear system in ntt domain as in fips203 algo 13 */
-  gen_matrix(a, pub_seed, 0);
-  for (int i = 0; i < mlkem_k; ++i) { gen_noise_poly_eta1(&dkpv.vec[i], noise_seed, nonce++); }
-  for (int i = 0; i < mlkem_k; ++i) { gen_noise_poly_eta1(&e.vec[i], noise_seed, nonce++); }
-  poly_vec_ntt(&dkpv);
-  poly_vec_ntt(&e);
-  for (int i = 0; i < mlkem_k; ++i) {
-    poly_vec_basemul(&ekpv.vec[i], &a[i], &dkpv);
+
+  for (int i = 0; i < P::mlkem_k; ++i) { gen_noise_poly_eta1<P>(&w->dkpv.vec[i], noise_seed, nonce++); }
+  for (int i = 0; i < P::mlkem_k; ++i) { gen_noise_poly_eta1<P>(&w->e.vec[i], noise_seed, nonce++); }
+  poly_vec_ntt(&w->dkpv);
+  poly_vec_ntt(&w->e);
+}
+
+template <typename P>
+static inline void indcpa_key_gen_products(uint8_t ek[P::ek_len], 
+    uint8_t dk[P::poly_vec_len], key_gen_work<P>* w) {
+  const uint8_t* pub_seed = w->seeds;
+  poly_vec<P>* a = w->a;
+  poly_vec<P> &e = w->e, &ekpv = w->ekpv, &dkpv = w->dkpv;
+
+  /* s and e leave the ntt unreduced, s is reduced once for packing */
+  static_assert(fits_montgomery(poly_vec_basemul_cached_acc_bound<P>(uniform_bound, ntt_bound(P::mlkem_eta1))), "A s overflows");
+  static_assert(fits_int16(add_bound(fqmul_bound(barrett_bound, (1ULL << 32) % mlkem_q), 
+    ntt_bound(P::mlkem_eta1))), "A s + e overflows");
+
+  poly_vec_mulcache_compute(&w->dkc, &dkpv);
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    if constexpr (stream_matrix) { gen_matrix_row(&a[0], pub_seed, i, 0); }
+    poly_vec_basemul(&ekpv.vec[i], &a[stream_matrix ? 0 : i], &dkpv, &w->dkc);
     poly_tomont(&ekpv.vec[i]);
   }
   poly_vec_add(&ekpv, &ekpv, &e);
   poly_vec_reduce(&ekpv);
+  poly_vec_reduce(&dkpv);
 
   pack_ek(ek, &ekpv, pub_seed);
   pack_dk(dk, &dkpv);
 }
 
+/* the process of calculating 
+ *   t = As + e 
+ * where A is a random matrix, t is ek, e is noise, s is dk 
+ * specified as noisy linear system in ntt domain as in fips203 algo 13 */
+template <typename P>
+static inline void indcpa_key_gen(uint8_t ek[P::ek_len], 
+    uint8_t dk[P::poly_vec_len], const uint8_t seeds[seed_len], key_gen_work<P>* w) {
+  MLKEM_STAGE(indcpa_key_gen);
+  indcpa_key_gen_seeds(w, seeds);
+  indcpa_key_gen_matrix(w);
+  indcpa_key_gen_noise(w);
+  indcpa_key_gen_products(ek, dk, w);
+}
+
+template <typename P>
+static inline void indcpa_key_gen(uint8_t ek[P::ek_len], 
+    uint8_t dk[P::poly_vec_len], const uint8_t seeds[seed_len]) {
+  key_gen_work<P> w;
+  indcpa_key_gen(ek, dk, seeds, &w);
+}
+
 /* Key generation scheme, specified as algo 16 and 19
  *
  *   ek: output encapsulation key 
  *   dk: output decapsulation key */
-inline void key_gen(uint8_t* ek, uint8_t* dk) {
+template <typename P>
+inline void key_gen(uint8_t* ek, uint8_t* dk, key_gen_work<P>* w) {
   uint8_t seeds[2 * seed_len];
   gen_rand_bytes(seeds, 2 * seed_len);
 
-  indcpa_key_gen(ek, dk, seeds);
+  indcpa_key_gen<P>(ek, dk, seeds, w);
 
-  memcpy(dk + poly_vec_len, ek, poly_vec_len + seed_len); /* store ek(ek and pub seed to gen matrix) after dk */
-  sha::sha3_256(dk + poly_vec_len + poly_vec_len + seed_len, ek, poly_vec_len + seed_len); /* also store ek hash */
-  memcpy(dk + 2 * poly_vec_len + seed_len + sha::hash256_len, seeds + seed_len, seed_len); /* rejection value z */
+  memcpy(dk + P::poly_vec_len, ek, P::ek_len); /* store ek(ek and pub seed to gen matrix) after dk */
+  {
+    MLKEM_STAGE(hash_h);
+    sha::sha3_256(dk + P::poly_vec_len + P::ek_len, ek, P::ek_len); /* also store ek hash */
+  }
+  memcpy(dk + P::poly_vec_len + P::ek_len + sha::hash256_len, seeds + seed_len, seed_len); /* rejection value z */
 }
 
-/* Helper: encapsulate a msg using the encapsulation key and random seed
+template <typename P>
+inline void key_gen(uint8_t* ek, uint8_t* dk) {
+  key_gen_work<P> w;
+  key_gen(ek, dk, &w);
+}
+
+/* Encapsulation key expanded once, for repeated encap to the same key
+ *
+ *   at: matrix A^T regenerated from the public seed, with MLKEM_STREAM_MATRIX 
+ *     only the seed rho is kept and each row is sampled when it is used
+ *   t: the ek poly vec, already in the ntt domain as stored in ek 
+ *   hek: H(ek) used in the G step of encap */
+template <typename P>
+struct expanded_ek {
+#ifdef MLKEM_STREAM_MATRIX
+  uint8_t rho[seed_len];
+#else
+  poly_vec<P> at[P::mlkem_k];
+#endif
+  poly_vec<P> t;
+  uint8_t hek[sha::hash256_len];
+};
+
+template <typename P>
+static inline void expand_at(expanded_ek<P>* eek, const uint8_t seed[seed_len]) {
+#ifdef MLKEM_STREAM_MATRIX
+  memcpy(eek->rho, seed, seed_len);
+#else
+  gen_matrix(eek->at, seed, 1);
+#endif
+}
+
+/* Row i of A^T, sampled into row when the matrix is streamed, the result is 
+ *   valid until the next call with the same row */
+template <typename P>
+static inline const poly_vec<P>* at_row(const expanded_ek<P>* eek, poly_vec<P>* row, int i) {
+#ifdef MLKEM_STREAM_MATRIX
+  gen_matrix_row(row, eek->rho, i, 1);
+  return row;
+#else
+  (void)row;
+  return &eek->at[i];
+#endif
+}
+
+template <typename P>
+inline void expand_ek(expanded_ek<P>* eek, const uint8_t ek[P::ek_len]) {
+  uint8_t seed[seed_len];
+  unpack_ek(&eek->t, seed, ek);
+  expand_at(eek, seed);
+  MLKEM_STAGE(hash_h);
+  sha::sha3_256(eek->hek, ek, P::ek_len);
+}
+
+template <typename P>
+struct enc_work {
+  poly_vec<P> y, u, e1, row;
+  poly_vec_mulcache<P> yc; /* cache of y, used against A^T and t */
+  poly v, e2, mu;
+};
+
+/* Stages of indcpa_enc, same split as key gen
  * */
-static inline void indcpa_enc(uint8_t c[compressed_poly_vec_len + compressed_poly_len],
-  const uint8_t m[msg_len], const uint8_t ek[poly_vec_len + seed_len], const uint8_t seed[seed_len]) {
-  
-  uint8_t seed_received[seed_len];
+
+template <typename P>
+static inline void indcpa_enc_noise(enc_work<P>* w, const uint8_t m[msg_len], const uint8_t seed[seed_len]) {
   uint8_t nonce = 0;
-  
-  poly_vec at[mlkem_k], y, u, e1, ekpv;
-  poly v, e2, mu;
 
-  unpack_ek(&ekpv, seed_received, ek);
-  msg_to_poly(&mu, m); /* convert msg to poly form */
-  
-  /* the encap process of calculating
-   *   u = A^{T}y + e1, v = t^{T}y + e2 + u */
-  gen_matrix(at, seed_received, 1); /* regen mat a used in key gen */
-  for (int i = 0; i < mlkem_k; ++i) {
-    gen_noise_poly_eta1(&y.vec[i], seed, nonce++);
+  msg_to_poly(&w->mu, m); /* convert msg to poly form */
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    gen_noise_poly_eta1<P>(&w->y.vec[i], seed, nonce++);
   }
-  for (int i = 0; i < mlkem_k; ++i) {
-    gen_noise_poly_eta2(&e1.vec[i], seed, nonce++);
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    gen_noise_poly_eta2<P>(&w->e1.vec[i], seed, nonce++);
   }
-  gen_noise_poly_eta2(&e2, seed, nonce++);
+  gen_noise_poly_eta2<P>(&w->e2, seed, nonce++);
+}
+
+template <typename P>
+static inline void indcpa_enc_products(enc_work<P>* w, const expanded_ek<P>* eek) {
+  /* y leaves the ntt unreduced, u and v are only reduced before compression */
+  static_assert(fits_montgomery(poly_vec_basemul_cached_acc_bound<P>(bytes_bound, ntt_bound(P::mlkem_eta1))), "A^T y overflows");
 
-  poly_vec_ntt(&y);
-  for (int i = 0; i < mlkem_k; ++i) {
-    poly_vec_basemul(&u.vec[i], &at[i], &y); /* u = A^{T}y + e1 */
+  poly_vec_ntt(&w->y);
+  poly_vec_mulcache_compute(&w->yc, &w->y);
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    poly_vec_basemul(&w->u.vec[i], at_row(eek, &w->row, i), &w->y, &w->yc); /* u = A^{T}y + e1 */
   }
-  poly_vec_basemul(&v, &ekpv, &y); /* v = t^{T}y + e2 + mu */
+  poly_vec_basemul(&w->v, &eek->t, &w->y, &w->yc); /* v = t^{T}y + e2 + mu */
+  poly_vec_invntt(&w->u);
+  poly_invntt(&w->v);
+}
+
+template <typename P>
+static inline void indcpa_enc_pack(uint8_t c[P::cipher_len], enc_work<P>* w) {
+  static_assert(fits_int16(add_bound(add_bound(invntt_bound(barrett_bound), P::mlkem_eta2), 
+    (mlkem_q + 1) / 2)), "v + e2 + mu overflows");
+
+  poly_vec_add(&w->u, &w->u, &w->e1);
+  poly_add(&w->v, &w->v, &w->e2);
+  poly_add(&w->v, &w->v, &w->mu);
+  poly_vec_reduce(&w->u);
+  poly_reduce(&w->v);
+
+  pack_cipher(c, &w->u, &w->v); /* byte encode */  
+}
+
+/* Helper: encapsulate a msg given the expanded A^T and t, and random seed
+ *
+ * the encap process of calculating
+ *   u = A^{T}y + e1, v = t^{T}y + e2 + u */
+template <typename P>
+static inline void indcpa_enc(uint8_t c[P::cipher_len], const uint8_t m[msg_len], 
+  const expanded_ek<P>* eek, const uint8_t seed[seed_len], enc_work<P>* w) {
+  MLKEM_STAGE(indcpa_enc);
+  indcpa_enc_noise(w, m, seed);
+  indcpa_enc_products(w, eek);
+  indcpa_enc_pack(c, w);
+}
 
-  poly_vec_invntt(&u);
-  poly_invntt(&v);
+template <typename P>
+static inline void indcpa_enc(uint8_t c[P::cipher_len], const uint8_t m[msg_len], 
+  const expanded_ek<P>* eek, const uint8_t seed[seed_len]) {
+  enc_work<P> w;
+  indcpa_enc(c, m, eek, seed, &w);
+}
+
+/* Helper: encapsulate a msg using the encapsulation key and random seed
+ * */
+template <typename P>
+static inline void indcpa_enc(uint8_t c[P::cipher_len],
+  const uint8_t m[msg_len], const uint8_t ek[P::ek_len], const uint8_t seed[seed_len]) {
   
-  poly_vec_add(&u, &u, &e1);
-  poly_add(&v, &v, &e2);
-  poly_add(&v, &v, &mu);
-  poly_vec_reduce(&u);
-  poly_reduce(&v);
+  uint8_t seed_received[seed_len];
+  expanded_ek<P> eek; /* hek is not needed here */
+
+  unpack_ek(&eek.t, seed_received, ek);
+  expand_at(&eek, seed_received); /* regen mat a used in key gen */
 
-  pack_cipher(c, &u, &v); /* byte encode */  
+  indcpa_enc(c, m, &eek, seed);
+}
+
+/* Encapsulate to an expanded key, only noise sampling and the products are 
+ *   left per call, same result as encap on the ek bytes it was expanded from
+ * */
+template <typename P>
+inline void encap(uint8_t* cipher, uint8_t* sk, const expanded_ek<P>* ek, enc_work<P>* w) {
+  uint8_t buf[seed_len + sha::hash256_len];
+  uint8_t kr[64]; /* hash of key and randomness */
+
+  gen_rand_bytes(buf, seed_len);
+  memcpy(buf + seed_len, ek->hek, sha::hash256_len);
+  {
+    MLKEM_STAGE(hash_g);
+    sha::sha3_512(kr, buf, seed_len + sha::hash256_len);
+  }
+
+  indcpa_enc(cipher, buf, ek, kr + seed_len, w);
+
+  memcpy(sk, kr, seed_len);
+}
+
+template <typename P>
+inline void encap(uint8_t* cipher, uint8_t* sk, const expanded_ek<P>* ek) {
+  enc_work<P> w;
+  encap(cipher, sk, ek, &w);
 }
 
 /* Encapsulate, specified as algo 17 and 20
@@ -150,35 +334,136 @@ static inline void indcpa_enc(uint8_t c[compressed_poly_vec_len + compressed_pol
  *   cipher: cipher text
  *   sk: the shared secret key used for future symmetric encryption 
  *   ek: the encryption key received */
+template <typename P>
 inline void encap(uint8_t* cipher, uint8_t* sk, const uint8_t* ek) {
-  uint8_t seed[seed_len];
-  gen_rand_bytes(seed, seed_len);
+  expanded_ek<P> eek;
+  expand_ek(&eek, ek);
+  encap(cipher, sk, &eek);
+}
 
-  uint8_t buf[seed_len + sha::hash256_len];
-  uint8_t kr[64]; /* hash of key and randomness */
+/* Helper: encapsulate four msgs to the same expanded A^T and t in lockstep,
+ *   noise of the four lanes is sampled by the 4-way keccak and each row of A^T
+ *   is used by all lanes back to back, only the first w lanes are packed
+ * */
+template <typename P>
+static inline void indcpa_enc_x4(uint8_t* const c[4], const uint8_t* const m[4], 
+  const expanded_ek<P>* eek, const uint8_t* const seed[4], int w) {
+  MLKEM_STAGE(indcpa_enc);
+
+  uint8_t nonce[4] = { 0, 0, 0, 0 };
+  /* same reductions, and so the same bounds, as indcpa_enc */
+
+  poly_vec<P> y[4], u[4], e1[4], row;
+  poly_vec_mulcache<P> yc[4];
+  const poly_vec<P>* at;
+  poly v[4], e2[4], mu;
+  poly* p[4];
+
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    for (int l = 0; l < 4; ++l) { p[l] = &y[l].vec[i]; }
+    gen_noise_poly_x4<P::mlkem_eta1>(p, seed, nonce);
+    for (int l = 0; l < 4; ++l) { nonce[l]++; }
+  }
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    for (int l = 0; l < 4; ++l) { p[l] = &e1[l].vec[i]; }
+    gen_noise_poly_x4<P::mlkem_eta2>(p, seed, nonce);
+    for (int l = 0; l < 4; ++l) { nonce[l]++; }
+  }
+  for (int l = 0; l < 4; ++l) { p[l] = &e2[l]; }
+  gen_noise_poly_x4<P::mlkem_eta2>(p, seed, nonce);
 
-  memcpy(buf, seed, seed_len);
+  for (int l = 0; l < w; ++l) {
+    poly_vec_ntt(&y[l]);
+    poly_vec_mulcache_compute(&yc[l], &y[l]);
+  }
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    at = at_row(eek, &row, i);
+    for (int l = 0; l < w; ++l) { poly_vec_basemul(&u[l].vec[i], at, &y[l], &yc[l]); }
+  }
+  for (int l = 0; l < w; ++l) { poly_vec_basemul(&v[l], &eek->t, &y[l], &yc[l]); }
 
-  sha::sha3_256(buf + seed_len, ek, poly_vec_len + seed_len);
-  sha::sha3_512(kr, buf, seed_len + sha::hash256_len);
+  for (int l = 0; l < w; ++l) {
+    poly_vec_invntt(&u[l]);
+    poly_invntt(&v[l]);
 
-  indcpa_enc(cipher, buf, ek, kr + seed_len);
+    msg_to_poly(&mu, m[l]);
+    poly_vec_add(&u[l], &u[l], &e1[l]);
+    poly_add(&v[l], &v[l], &e2[l]);
+    poly_add(&v[l], &v[l], &mu);
+    poly_vec_reduce(&u[l]);
+    poly_reduce(&v[l]);
 
-  memcpy(sk, kr, seed_len);
+    pack_cipher(c[l], &u[l], &v[l]);
+  }
 }
 
-/* Helper: decapsulate 
+/* Encapsulate n times to the same expanded key, msgs go four at a time
+ *   through the G step on the 4-way keccak and indcpa_enc_x4, each output is
+ *   the one encap would give for the same random bytes
+ *
+ *   ciphers: n ciphers of P::cipher_len bytes back to back 
+ *   sks: n shared secrets of 32 bytes back to back */
+template <typename P>
+inline void encap_batch(uint8_t* ciphers, uint8_t* sks, size_t n, const expanded_ek<P>* ek) {
+  uint8_t coins[4 * seed_len];
+  uint8_t buf[4][seed_len + sha::hash256_len];
+  uint8_t kr[4][64]; /* hash of key and randomness */
+  uint8_t* c[4];
+  const uint8_t* m[4];
+  const uint8_t* seed[4];
+
+  for (size_t b = 0; b < n; b += 4) {
+    int w = (n - b < 4) ? (int)(n - b) : 4;
+    gen_rand_bytes(coins, w * seed_len);
+    for (int l = 0; l < 4; ++l) {
+      memcpy(buf[l], coins + (l < w ? l : 0) * seed_len, seed_len); /* idle lanes redo lane 0 */
+      memcpy(buf[l] + seed_len, ek->hek, sha::hash256_len);
+      c[l] = (l < w) ? ciphers + (b + l) * P::cipher_len : nullptr;
+      m[l] = buf[l];
+      seed[l] = kr[l] + seed_len;
+    }
+    {
+      MLKEM_STAGE(hash_g);
+      sha::sha3_512x4(kr[0], kr[1], kr[2], kr[3], buf[0], buf[1], buf[2], buf[3], seed_len + sha::hash256_len);
+    }
+
+    indcpa_enc_x4(c, m, ek, seed, w);
+
+    for (int l = 0; l < w; ++l) { memcpy(sks + (b + l) * seed_len, kr[l], seed_len); }
+  }
+}
+
+template <typename P>
+inline void encap_batch(uint8_t* ciphers, uint8_t* sks, size_t n, const uint8_t* ek) {
+  expanded_ek<P> eek;
+  expand_ek(&eek, ek);
+  encap_batch(ciphers, sks, n, &eek);
+}
+
+/* Helper: decapsulate with the secret poly vec s in the ntt domain
  * 
  *   m: output message 
  *   cipher: cipher received 
- *   dk: decapsulation key */
-static inline void indcpa_dec(uint8_t m[msg_len], 
-  const uint8_t cipher[compressed_poly_vec_len + compressed_poly_len], uint8_t dk[poly_vec_len]) {
-  poly_vec u, dkpv;
+ *   dkpv: decapsulation key poly vec 
+ *   dkc: its multiplication cache */
+template <typename P>
+struct dec_work {
+  poly_vec<P> u;
   poly v, w;
+};
+
+template <typename P>
+static inline void indcpa_dec(uint8_t m[msg_len], 
+  const uint8_t cipher[P::cipher_len], const poly_vec<P>* dkpv, const poly_vec_mulcache<P>* dkc, dec_work<P>* dw) {
+  MLKEM_STAGE(indcpa_dec);
+  poly_vec<P>& u = dw->u;
+  poly &v = dw->v, &w = dw->w;
+
+  /* u leaves the ntt unreduced */
+  static_assert(fits_montgomery(poly_vec_basemul_cached_acc_bound<P>(ntt_bound(decompress_bound), bytes_bound)), "s^T u overflows");
+  static_assert(fits_int16(add_bound(decompress_bound, invntt_bound(barrett_bound))), "v - w overflows");
 
   unpack_cipher(&u, &v, cipher);
-  unpack_dk(&dkpv, dk); // dkpv is now in the ntt domain
 
   /* process of calculating
    *   w = v' - invntt(s^T(u')) 
@@ -186,7 +471,7 @@ static inline void indcpa_dec(uint8_t m[msg_len],
    * and decompression alter their values */
   poly_vec_ntt(&u); // u to ntt domain
 
-  poly_vec_basemul(&w, &dkpv, &u);
+  poly_vec_basemul(&w, &u, dkpv, dkc);
   poly_invntt(&w);
   poly_sub(&w, &v, &w);
   poly_reduce(&w);
@@ -194,31 +479,383 @@ static inline void indcpa_dec(uint8_t m[msg_len],
   poly_to_msg(m, &w);
 }
 
-/* Decapsulation, specified as algo 18 and 21
+template <typename P>
+static inline void indcpa_dec(uint8_t m[msg_len], 
+  const uint8_t cipher[P::cipher_len], const poly_vec<P>* dkpv, const poly_vec_mulcache<P>* dkc) {
+  dec_work<P> w;
+  indcpa_dec(m, cipher, dkpv, dkc, &w);
+}
+
+/* Helper: indcpa_dec of 16 ciphers under one key on the poly_soa layout, 
+ *   lane l holds cipher l, u is decompressed into the lanes and w leaves 
+ *   them before the subtraction, so the ntt, the inner product with the 
+ *   shared s and the invntt each run once for all 16, same messages as
+ *   indcpa_dec */
+template <typename P>
+static inline void indcpa_dec_x16(uint8_t m[16][msg_len], const uint8_t* const cipher[16], 
+  const poly_vec<P>* dkpv, const poly_vec_mulcache<P>* dkc) {
+  MLKEM_STAGE(indcpa_dec);
+  poly_soa<16> u[P::mlkem_k];
+  poly v, w;
+
+  static_assert(fits_montgomery(poly_vec_basemul_cached_acc_bound<P>(ntt_bound(decompress_bound), bytes_bound)), "s^T u overflows");
+  static_assert(fits_int16(add_bound(decompress_bound, invntt_bound(barrett_bound))), "v - w overflows");
+
+  for (int l = 0; l < 16; ++l) {
+    for (int i = 0; i < P::mlkem_k; ++i) {
+      poly_soa_decompress<P::mlkem_du>(&u[i], l, cipher[l] + i * P::mlkem_du * mlkem_n / 8);
+    }
+  }
+  for (int i = 0; i < P::mlkem_k; ++i) { poly_soa_ntt(&u[i]); }
+  poly_soa_basemul_acc_shared<P::mlkem_k>(&u[0], u, dkpv->vec, dkc->vec); /* w of every lane in u[0] */
+  poly_soa_invntt(&u[0]);
+
+  for (int l = 0; l < 16; ++l) {
+    poly_soa_store(&w, &u[0], l);
+    poly_decompress<P::mlkem_dv>(&v, cipher[l] + P::compressed_poly_vec_len);
+    poly_sub(&w, &v, &w);
+    poly_reduce(&w);
+    poly_to_msg(m[l], &w);
+  }
+}
+
+/* Helper: decapsulate 
  * 
- *   ss: output shared secret key */
-inline void decap(uint8_t* ss, uint8_t* cipher, uint8_t* dk) {
-  int fail;
+ *   m: output message 
+ *   cipher: cipher received 
+ *   dk: decapsulation key */
+template <typename P>
+static inline void indcpa_dec(uint8_t m[msg_len], 
+  const uint8_t cipher[P::cipher_len], const uint8_t dk[P::poly_vec_len]) {
+  poly_vec<P> dkpv;
+  poly_vec_mulcache<P> dkc;
+  unpack_dk(&dkpv, dk); // dkpv is now in the ntt domain
+  poly_vec_mulcache_compute(&dkc, &dkpv);
+  indcpa_dec(m, cipher, &dkpv, &dkc);
+}
+
+/* Decapsulation key expanded once, for repeated decap with a static key
+ *
+ *   s: the secret poly vec, in the ntt domain as stored in dk 
+ *   sc: multiplication cache of s, kept for the life of the key 
+ *   ek: A^T, t and H(ek) used by the fo re-encryption, H(ek) is taken from dk 
+ *   z: the implicit rejection value */
+template <typename P>
+struct expanded_dk {
+  poly_vec<P> s;
+  poly_vec_mulcache<P> sc;
+  expanded_ek<P> ek;
+  uint8_t z[seed_len];
+};
+
+template <typename P>
+inline void expand_dk(expanded_dk<P>* edk, const uint8_t dk[P::dk_len]) {
+  uint8_t seed[seed_len];
+  unpack_dk(&edk->s, dk);
+  poly_vec_mulcache_compute(&edk->sc, &edk->s);
+  unpack_ek(&edk->ek.t, seed, dk + P::poly_vec_len);
+  expand_at(&edk->ek, seed);
+  memcpy(edk->ek.hek, dk + P::poly_vec_len + P::ek_len, sha::hash256_len);
+  memcpy(edk->z, dk + P::poly_vec_len + P::ek_len + sha::hash256_len, seed_len);
+}
+
+/* Scratch of decap, indcpa_dec and the re-encryption run one after the other
+ *   cmp: used to store newly generated cipher */
+template <typename P>
+struct decap_work {
+  union {
+    dec_work<P> dec;
+    enc_work<P> enc;
+  };
+  uint8_t cmp[P::cipher_len];
+};
+
+/* Helper: last step of decap, ss is K' from kr if the re-encryption cmp
+ *   matches cipher and the rejection key J(z, c) otherwise */
+template <typename P>
+static inline void decap_select(uint8_t* ss, const uint8_t* cipher, const uint8_t* cmp,
+  const expanded_dk<P>* dk, const uint8_t kr[msg_len + seed_len]) {
+  int fail = ccmp(cipher, cmp, P::cipher_len);
+
+  {
+    MLKEM_STAGE(rkprf);
+    shake256_rkprf<P>(ss, dk->z, cipher); /* compute rejection key */
+  }
+
+  cmov(ss, kr, seed_len, !fail); /* constant copy kr */
+}
+
+/* Decapsulate with an expanded key, no key decoding or matrix expansion is 
+ *   left per call, same result as decap on the dk bytes it was expanded from
+ * */
+template <typename P>
+inline void decap(uint8_t* ss, const uint8_t* cipher, const expanded_dk<P>* dk, decap_work<P>* w) {
   /* cipher text decrypted, contains shared key and random seed for fo transform*/
   uint8_t buf[msg_len + sha::hash256_len];
   /* key and random seed used to re-encrypt */
   uint8_t kr[msg_len + seed_len];
-  /* used to store newly generated cipher */
-  uint8_t cmp[compressed_poly_vec_len + compressed_poly_len];
-  const uint8_t* ek = dk + poly_vec_len;
+  uint8_t* cmp = w->cmp;
 
-  indcpa_dec(buf, cipher, dk);
+  indcpa_dec(buf, cipher, &dk->s, &dk->sc, &w->dec);
 
-  memcpy(buf + msg_len, dk + 2 * poly_vec_len + seed_len, sha::hash256_len); /* extract hash of encap key */
-  sha::sha3_512(kr, buf, msg_len + sha::hash256_len);
+  memcpy(buf + msg_len, dk->ek.hek, sha::hash256_len); /* hash of encap key */
+  {
+    MLKEM_STAGE(hash_g);
+    sha::sha3_512(kr, buf, msg_len + sha::hash256_len);
+  }
 
-  indcpa_enc(cmp, buf, ek, kr + msg_len); /* recalculate encrypted msg */
+  indcpa_enc(cmp, buf, &dk->ek, kr + msg_len, &w->enc); /* recalculate encrypted msg */
 
-  fail = ccmp(cipher, cmp, compressed_poly_vec_len + compressed_poly_len);
+  decap_select(ss, cipher, cmp, dk, kr);
+}
 
-  shake256_rkprf(ss, dk + 2 * poly_vec_len + seed_len + sha::hash256_len, cipher); /* compute rejection key */
+template <typename P>
+inline void decap(uint8_t* ss, const uint8_t* cipher, const expanded_dk<P>* dk) {
+  decap_work<P> w;
+  decap(ss, cipher, dk, &w);
+}
 
-  cmov(ss, kr, seed_len, !fail); /* constant copy kr */
+/* Decapsulation, specified as algo 18 and 21
+ * 
+ *   ss: output shared secret key */
+template <typename P>
+inline void decap(uint8_t* ss, const uint8_t* cipher, const uint8_t* dk) {
+  expanded_dk<P> edk;
+  expand_dk(&edk, dk);
+  decap(ss, cipher, &edk);
+}
+
+/* Scratch of one operation of set P, the expanded key and the work of the 
+ *   operation that uses it, dk.ek also holds the expanded ek of encap */
+template <typename P>
+struct kem_work {
+  expanded_dk<P> dk;
+  union {
+    key_gen_work<P> key_gen;
+    enc_work<P> enc;
+    decap_work<P> decap;
+  };
+};
+
+/* Caller owned scratch for the workspace overloads, large enough for any 
+ *   parameter set, used by one operation at a time, its contents do not need 
+ *   to survive between calls
+ *
+ *   with a workspace only the kernels' own buffers (keccak states, squeeze 
+ *   blocks, compression tails) stay on the stack, workspace_stack_bound gives
+ *   the peak per operation and parameter set */
+typedef struct {
+  alignas(64) unsigned char bytes[sizeof(kem_work<mlkem1024>)];
+} workspace;
+
+template <typename P>
+inline kem_work<P>* work_of(workspace* ws) {
+  static_assert(sizeof(kem_work<P>) <= sizeof(workspace), "workspace is sized for the largest set");
+  return new (ws->bytes) kem_work<P>;
+}
+
+/* Peak stack in bytes of the workspace overloads, bench_stack measures it on
+ *   a painted stack and fails (under ctest too) above these
+ *
+ *   measured with gcc 12 and the avx2 kernels, key gen / encap / decap
+ *            -O3                  -O0
+ *      512   6432  5824  5632     7208  7144  7144
+ *      768   6560  5824  5696     7272  7208  7208
+ *     1024   6752  5824  5728     7336  7240  7240
+ *   a bound is the -O0 peak plus a third, rounded up to 256 bytes, the sets 
+ *   barely differ since what stays on the stack is sized by a poly or a 
+ *   keccak state, not by k, MLKEM_STREAM_MATRIX and MLKEM_NO_SIMD peak lower,
+ *   without a workspace decap 1024 takes 31 KiB at -O3
+ *
+ *   the bounds hold for gcc on x86-64 at -O0 to -O3 and -Os, also with 
+ *   -fsanitize=undefined or thread and -fstack-protector-all (at most 7496
+ *   bytes), they do not hold under -fsanitize=address, whose redzones take 
+ *   the peaks to 11032, and are unmeasured for other compilers, 
+ *   MLKEM_STACK_BOUND_HOLDS says whether the build is one they hold for */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && !defined(__SANITIZE_ADDRESS__)
+#define MLKEM_STACK_BOUND_HOLDS 1
+#else
+#define MLKEM_STACK_BOUND_HOLDS 0
+#endif
+
+typedef struct {
+  size_t key_gen;
+  size_t encap;
+  size_t decap;
+} stack_bound;
+
+constexpr size_t stack_bound_of(size_t peak) { return (peak + peak / 3 + 255) / 256 * 256; }
+
+template <typename P>
+constexpr stack_bound workspace_stack_bound =
+  (P::mlkem_k == 2) ? stack_bound{ stack_bound_of(7208), stack_bound_of(7144), stack_bound_of(7144) } :
+  (P::mlkem_k == 3) ? stack_bound{ stack_bound_of(7272), stack_bound_of(7208), stack_bound_of(7208) } :
+                      stack_bound{ stack_bound_of(7336), stack_bound_of(7240), stack_bound_of(7240) };
+
+template <typename P>
+inline void key_gen(uint8_t* ek, uint8_t* dk, workspace* ws) {
+  key_gen(ek, dk, &work_of<P>(ws)->key_gen);
+}
+
+template <typename P>
+inline void encap(uint8_t* cipher, uint8_t* sk, const expanded_ek<P>* ek, workspace* ws) {
+  encap(cipher, sk, ek, &work_of<P>(ws)->enc);
+}
+
+template <typename P>
+inline void encap(uint8_t* cipher, uint8_t* sk, const uint8_t* ek, workspace* ws) {
+  kem_work<P>* w = work_of<P>(ws);
+  expand_ek(&w->dk.ek, ek);
+  encap(cipher, sk, &w->dk.ek, &w->enc);
+}
+
+template <typename P>
+inline void decap(uint8_t* ss, const uint8_t* cipher, const expanded_dk<P>* dk, workspace* ws) {
+  decap(ss, cipher, dk, &work_of<P>(ws)->decap);
+}
+
+template <typename P>
+inline void decap(uint8_t* ss, const uint8_t* cipher, const uint8_t* dk, workspace* ws) {
+  kem_work<P>* w = work_of<P>(ws);
+  expand_dk(&w->dk, dk);
+  decap(ss, cipher, &w->dk, &w->decap);
+}
+
+/* Decapsulate n ciphers with the same expanded key, each whole group of 16
+ *   ciphers is decrypted by indcpa_dec_x16 and the rest one by one, they then
+ *   go four at a time through the G step on the 4-way keccak, indcpa_enc_x4
+ *   for the fo re-encryption and the 4-way rejection prf, each output is the 
+ *   one decap would give for the same cipher, the 16 lanes of u take 
+ *   k * 8 KiB of stack
+ *
+ *   sss: n shared secrets of 32 bytes back to back 
+ *   ciphers: n ciphers of P::cipher_len bytes back to back */
+template <typename P>
+inline void decap_batch(uint8_t* sss, const uint8_t* ciphers, size_t n, const expanded_dk<P>* dk) {
+  int fail;
+  /* cipher texts decrypted, contain shared key and random seed for fo transform */
+  uint8_t buf[4][msg_len + sha::hash256_len];
+  /* keys and random seeds used to re-encrypt */
+  uint8_t kr[4][msg_len + seed_len];
+  /* used to store newly generated ciphers */
+  uint8_t cmp[4][P::cipher_len];
+  const uint8_t* cipher[4];
+  const uint8_t* m[4];
+  const uint8_t* seed[4];
+  uint8_t* c[4];
+  uint8_t* ss[4];
+  uint8_t rej[4][msg_len];
+  /* decrypted msgs of a group of 16 */
+  uint8_t msg[16][msg_len];
+  const uint8_t* cipher16[16];
+
+  for (size_t b = 0; b < n; b += 4) {
+    int w = (n - b < 4) ? (int)(n - b) : 4;
+    size_t g = b % 16;
+    if (g == 0 && n - b >= 16) {
+      for (int l = 0; l < 16; ++l) { cipher16[l] = ciphers + (b + l) * P::cipher_len; }
+      indcpa_dec_x16(msg, cipher16, &dk->s, &dk->sc);
+    } else if (g == 0) {
+      for (size_t l = 0; l < n - b; ++l) { indcpa_dec(msg[l], ciphers + (b + l) * P::cipher_len, &dk->s, &dk->sc); }
+    }
+    for (int l = 0; l < 4; ++l) {
+      cipher[l] = ciphers + (b + (l < w ? l : 0)) * P::cipher_len; /* idle lanes redo lane 0 */
+      m[l] = buf[l];
+      seed[l] = kr[l] + msg_len;
+      c[l] = cmp[l];
+      ss[l] = rej[l];
+    }
+
+    for (int l = 0; l < 4; ++l) {
+      memcpy(buf[l], msg[g + (l < w ? l : 0)], msg_len);
+      memcpy(buf[l] + msg_len, dk->ek.hek, sha::hash256_len); /* hash of encap key */
+    }
+    {
+      MLKEM_STAGE(hash_g);
+      sha::sha3_512x4(kr[0], kr[1], kr[2], kr[3], buf[0], buf[1], buf[2], buf[3], msg_len + sha::hash256_len);
+    }
+
+    indcpa_enc_x4(c, m, &dk->ek, seed, w); /* recalculate encrypted msgs */
+
+    {
+      MLKEM_STAGE(rkprf);
+      shake256_rkprf_x4<P>(ss, dk->z, cipher); /* compute rejection keys */
+    }
+
+    for (int l = 0; l < w; ++l) {
+      fail = ccmp(cipher[l], cmp[l], P::cipher_len);
+      cmov(rej[l], kr[l], seed_len, !fail); /* constant copy kr */
+      memcpy(sss + (b + l) * msg_len, rej[l], msg_len);
+    }
+  }
+}
+
+template <typename P>
+inline void decap_batch(uint8_t* sss, const uint8_t* ciphers, size_t n, const uint8_t* dk) {
+  expanded_dk<P> edk;
+  expand_dk(&edk, dk);
+  decap_batch(sss, ciphers, n, &edk);
+}
+
+/* Runtime api, the parameter set is picked per call and forwarded to the 
+ *   matching compile time instantiation, calls with an unknown set return -1 */
+
+template <typename F>
+inline int with_params(param_set set, F&& f) {
+  switch (set) {
+    case param_set::mlkem512: f(mlkem512{}); return 0;
+    case param_set::mlkem768: f(mlkem768{}); return 0;
+    case param_set::mlkem1024: f(mlkem1024{}); return 0;
+  }
+  return -1;
+}
+
+/* Byte lens of the keys and cipher of a parameter set, all zero if unknown */
+typedef struct {
+  size_t ek_len;
+  size_t dk_len;
+  size_t cipher_len;
+} param_lens;
+
+inline param_lens lens_of(param_set set) {
+  param_lens l = { 0, 0, 0 };
+  with_params(set, [&](auto p) {
+    using P = decltype(p);
+    l = { P::ek_len, P::dk_len, P::cipher_len };
+  });
+  return l;
+}
+
+inline int key_gen(param_set set, uint8_t* ek, uint8_t* dk) {
+  return with_params(set, [&](auto p) { key_gen<decltype(p)>(ek, dk); });
+}
+
+inline int encap(param_set set, uint8_t* cipher, uint8_t* ss, const uint8_t* ek) {
+  return with_params(set, [&](auto p) { encap<decltype(p)>(cipher, ss, ek); });
+}
+
+inline int key_gen(param_set set, uint8_t* ek, uint8_t* dk, workspace* ws) {
+  return with_params(set, [&](auto p) { key_gen<decltype(p)>(ek, dk, ws); });
+}
+
+inline int encap(param_set set, uint8_t* cipher, uint8_t* ss, const uint8_t* ek, workspace* ws) {
+  return with_params(set, [&](auto p) { encap<decltype(p)>(cipher, ss, ek, ws); });
+}
+
+inline int encap_batch(param_set set, uint8_t* ciphers, uint8_t* sks, size_t n, const uint8_t* ek) {
+  return with_params(set, [&](auto p) { encap_batch<decltype(p)>(ciphers, sks, n, ek); });
+}
+
+inline int decap(param_set set, uint8_t* ss, const uint8_t* cipher, const uint8_t* dk) {
+  return with_params(set, [&](auto p) { decap<decltype(p)>(ss, cipher, dk); });
+}
+
+inline int decap(param_set set, uint8_t* ss, const uint8_t* cipher, const uint8_t* dk, workspace* ws) {
+  return with_params(set, [&](auto p) { decap<decltype(p)>(ss, cipher, dk, ws); });
+}
+
+inline int decap_batch(param_set set, uint8_t* sss, const uint8_t* ciphers, size_t n, const uint8_t* dk) {
+  return with_params(set, [&](auto p) { decap_batch<decltype(p)>(sss, ciphers, n, dk); });
 }
 
 } /* namespace mlkem */
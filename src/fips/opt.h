@@ -5,14 +5,18 @@
 #ifndef OPT_H
 #define OPT_H
 
+#include <cstdint>
+
 #include "common.h"
+#include "cpu.h"
+#include "prof.h"
 
 namespace mlkem
 {
 
 /* Calc t = a * 2^{-16} mod q, where t in (-q, q)
  * */
-inline int16_t montgomery_reduce(int32_t a) {
+constexpr int16_t montgomery_reduce(int32_t a) {
   int16_t t;
   // find t = m s.t. a + m * q = 0 mod 2^16
   t = (int16_t)a * mlkem_inverse_q;
@@ -24,7 +28,7 @@ inline int16_t montgomery_reduce(int32_t a) {
  * to calc, need to find a - q * floor(a/q) normally, by replace a/q by a * (v / 2^k) where
  *   v /approx (2^k / q)
  * */
-inline int16_t barrett_reduce(int16_t a) {
+constexpr int16_t barrett_reduce(int16_t a) {
   int16_t t;
   // v = floor(2^26/q + 1/2)
   const int16_t v = ((1 << 26) + mlkem_q / 2) / mlkem_q;
@@ -33,77 +37,529 @@ inline int16_t barrett_reduce(int16_t a) {
   return a - t;
 }
 
-static inline int16_t fqmul(int16_t a, int16_t b) {
+constexpr int16_t fqmul(int16_t a, int16_t b) {
   return montgomery_reduce((int32_t)a * b);
 }
 
-/* zetas_impl * 2^16 mod 3329 = zeta_fips203 */
-const int16_t zetas[128] = {
-  -1044,  -758,  -359, -1517,  1493,  1422,   287,   202,
-   -171,   622,  1577,   182,   962, -1202, -1474,  1468,
-    573, -1325,   264,   383,  -829,  1458, -1602,  -130,
-   -681,  1017,   732,   608, -1542,   411,  -205, -1571,
-   1223,   652,  -552,  1015, -1293,  1491,  -282, -1544,
-    516,    -8,  -320,  -666, -1618, -1162,   126,  1469,
-   -853,   -90,  -271,   830,   107, -1421,  -247,  -951,
-   -398,   961, -1508,  -725,   448, -1065,   677, -1275,
-  -1103,   430,   555,   843, -1251,   871,  1550,   105,
-    422,   587,   177,  -235,  -291,  -460,  1574,  1653,
-   -246,   778,  1159,  -147,  -777,  1483,  -602,  1119,
-  -1590,   644,  -872,   349,   418,   329,  -156,   -75,
-    817,  1097,   603,   610,  1322, -1285, -1465,   384,
-  -1215,  -136,  1218, -1335,  -874,   220, -1187, -1659,
-  -1185, -1530, -1278,   794, -1510,  -854,  -870,   478,
-   -108,  -308,   996,   991,   958, -1460,  1522,  1628
-};
+/* Modular helpers for the tables below, all evaluated at compile time
+ * */
+constexpr int32_t mlkem_root = 17; /* primitive 256th root of unity mod q */
 
-inline void ntt(int16_t v[256]) {
-  unsigned int j, len, start, k = 1;
-  int16_t zeta, t;
-  for (len = 128; len >= 2; len >>= 1) {
-    for (start = 0; start < 256; start = j + len) {
-      zeta = zetas[k++];
-      for (j = start; j < start + len; ++j) {
-        t = fqmul(zeta, v[j + len]);
-        v[j + len] = v[j] - t;
-        v[j] = v[j] + t;
+constexpr int32_t mod_q(int64_t a) {
+  a %= mlkem_q;
+  return (int32_t)(a < 0 ? a + mlkem_q : a);
+}
+
+constexpr int32_t pow_mod_q(int64_t b, unsigned int e) {
+  int64_t r = 1;
+  for (b = mod_q(b); e; e >>= 1, b = b * b % mlkem_q) {
+    if (e & 1) { r = r * b % mlkem_q; }
+  }
+  return (int32_t)r;
+}
+
+/* Representative of a mod q in [-(q-1)/2, (q-1)/2] */
+constexpr int16_t centered_mod_q(int64_t a) {
+  int32_t r = mod_q(a);
+  return (int16_t)(r > mlkem_q / 2 ? r - mlkem_q : r);
+}
+
+constexpr unsigned int bit_reverse7(unsigned int i) {
+  unsigned int r = 0;
+  for (int b = 0; b < 7; ++b) { r |= ((i >> b) & 1) << (6 - b); }
+  return r;
+}
+
+/* z * q^-1 mod 2^16, the montgomery factor of any product by z, so that a
+ *   product by a fixed twiddle does not have to compute it per call */
+constexpr int16_t mont_qinv(int16_t z) {
+  return (int16_t)(uint16_t)((uint32_t)(uint16_t)z * (uint16_t)mlkem_inverse_q);
+}
+
+/* Twiddles of ntt, invntt and basemul, generated from q and the root
+ *
+ *   zetas: mont * root^brv7(i) mod q, zetas_impl * 2^16 mod 3329 = zeta_fips203
+ *   gammas: x^2 - gamma of basemul pair i, +zetas[64 + i/2] then -zetas[64 + i/2]
+ *   f: invntt scaling mont^2/128
+ *   fz: zetas[1] * f / mont, the twiddle of the last invntt layer with the 
+ *     scaling merged in, so that layer does one product per coefficient
+ *   each *_qinv holds mont_qinv of the twiddle next to it */
+typedef struct {
+  int16_t zetas[128], zetas_qinv[128];
+  int16_t gammas[128], gammas_qinv[128];
+  int16_t f, f_qinv;
+  int16_t fz, fz_qinv;
+} ntt_plan_t;
+
+constexpr ntt_plan_t make_ntt_plan() {
+  ntt_plan_t p{};
+  const int64_t mont = pow_mod_q(2, 16);
+  const int64_t mont_inv = pow_mod_q(mont, mlkem_q - 2);
+  for (unsigned int i = 0; i < 128; ++i) {
+    p.zetas[i] = centered_mod_q(mont * pow_mod_q(mlkem_root, bit_reverse7(i)));
+    p.zetas_qinv[i] = mont_qinv(p.zetas[i]);
+  }
+  for (unsigned int i = 0; i < 128; ++i) {
+    p.gammas[i] = (i & 1) ? (int16_t)-p.zetas[64 + i / 2] : p.zetas[64 + i / 2];
+    p.gammas_qinv[i] = mont_qinv(p.gammas[i]);
+  }
+  p.f = centered_mod_q(mont * mont % mlkem_q * pow_mod_q(128, mlkem_q - 2));
+  p.f_qinv = mont_qinv(p.f);
+  p.fz = centered_mod_q(p.zetas[1] * p.f % mlkem_q * mont_inv);
+  p.fz_qinv = mont_qinv(p.fz);
+  return p;
+}
+
+inline constexpr ntt_plan_t ntt_plan = make_ntt_plan();
+
+static_assert(ntt_plan.zetas[0] == -1044 && ntt_plan.zetas[127] == 1628 && ntt_plan.f == 1441, 
+  "twiddles as in the reference tables");
+
+/* fqmul by a twiddle z with zq = mont_qinv(z), same result as fqmul(a, z) 
+ * */
+constexpr int16_t fqmul_pre(int16_t a, int16_t z, int16_t zq) {
+  int16_t t = (int16_t)(a * zq);
+  return (int16_t)(((int32_t)a * z - (int32_t)t * mlkem_q) >> 16);
+}
+
+/* Coefficient bounds
+ *
+ *   a bound b of a poly means |c| <= b for all its coefficients, the functions
+ *   below give the bound after a kernel from the bounds before it so a caller 
+ *   that leaves out a reduction can static_assert the result still fits int16,
+ *   a step that may overflow gives bound_overflow, which fails every check */
+constexpr int32_t bound_overflow = INT32_MAX;
+
+constexpr bool fits_int16(int32_t b) {
+  return b <= INT16_MAX;
+}
+
+constexpr int32_t max_bound(int32_t a, int32_t b) {
+  return a > b ? a : b;
+}
+
+constexpr int32_t add_bound(int32_t a, int32_t b) {
+  return (fits_int16(a) && fits_int16(b) && fits_int16(a + b)) ? a + b : bound_overflow;
+}
+
+/* |montgomery_reduce(a * b)|, which is at most (|a * b| + 2^15 q) / 2^16 */
+constexpr int32_t fqmul_bound(int32_t a, int32_t b) {
+  if (!fits_int16(a) || !fits_int16(b)) { return bound_overflow; }
+  return (int32_t)(((int64_t)a * b + ((int64_t)mlkem_q << 15)) >> 16);
+}
+
+/* Largest |barrett_reduce(a)| over all int16 a */
+constexpr int32_t barrett_bound = [] {
+  int32_t m = 0;
+  for (int32_t a = INT16_MIN; a <= INT16_MAX; ++a) {
+    int32_t t = barrett_reduce((int16_t)a);
+    m = max_bound(m, t < 0 ? -t : t);
+  }
+  return m;
+}();
+
+constexpr int32_t zeta_bound = [] {
+  int32_t m = 0;
+  for (int i = 0; i < 128; ++i) { m = max_bound(m, ntt_plan.zetas[i] < 0 ? -ntt_plan.zetas[i] : ntt_plan.zetas[i]); }
+  return m;
+}();
+
+/* Each ntt layer adds a montgomery product to the bound, no reduction */
+constexpr int32_t ntt_bound(int32_t b) {
+  for (int layer = 0; layer < 7; ++layer) { b = add_bound(b, fqmul_bound(zeta_bound, b)); }
+  return b;
+}
+
+/* The only invntt layer whose sums are barrett reduced, sums of the others 
+ *   grow lazily, every difference goes through a montgomery product */
+constexpr unsigned int invntt_reduce_len = 16;
+
+constexpr int32_t invntt_bound(int32_t b) {
+  for (unsigned int len = 2; len <= 64; len <<= 1) {
+    int32_t sum = add_bound(b, b);
+    int32_t diff = fqmul_bound(zeta_bound, sum);
+    if (len == invntt_reduce_len && fits_int16(sum)) { sum = barrett_bound; }
+    b = max_bound(sum, diff);
+  }
+  /* the last layer scales the sum by f and the difference by fz */
+  b = add_bound(b, b);
+  return max_bound(fqmul_bound(b, ntt_plan.f), fqmul_bound(b, ntt_plan.fz < 0 ? -ntt_plan.fz : ntt_plan.fz));
+}
+
+/* Butterflies with twiddle k of the plan */
+static inline void butterfly(int16_t& a, int16_t& b, unsigned int k) {
+  int16_t t = fqmul_pre(b, ntt_plan.zetas[k], ntt_plan.zetas_qinv[k]);
+  b = a - t;
+  a = a + t;
+}
+
+template <bool reduce>
+static inline void invbutterfly(int16_t& a, int16_t& b, unsigned int k) {
+  int16_t t = a;
+  a = t + b;
+  if constexpr (reduce) { a = barrett_reduce(a); }
+  b = fqmul_pre(b - t, ntt_plan.zetas[k], ntt_plan.zetas_qinv[k]);
+}
+
+/* Last invntt layer, the one with twiddle 1, scaled by f as it goes */
+static inline void invbutterfly_last(int16_t& a, int16_t& b) {
+  int16_t t = a;
+  a = fqmul_pre(t + b, ntt_plan.f, ntt_plan.f_qinv);
+  b = fqmul_pre(b - t, ntt_plan.fz, ntt_plan.fz_qinv);
+}
+
+/* Two forward layers on 4 coefficients kept in registers, x[m] is the m-th 
+ *   coefficient of a group spaced by the len of the last layer, the layers use
+ *   zetas k and 2k + (0, 1) */
+MLKEM_ALWAYS_INLINE static inline void ntt_merge2(int16_t x[4], unsigned int k) {
+  butterfly(x[0], x[2], k);
+  butterfly(x[1], x[3], k);
+  butterfly(x[0], x[1], 2 * k);
+  butterfly(x[2], x[3], 2 * k + 1);
+}
+
+/* Three forward layers on 8 coefficients, as ntt_merge2, the layers use zetas 
+ *   k, 2k + (0, 1) and 4k + (0..3) */
+MLKEM_ALWAYS_INLINE static inline void ntt_merge3(int16_t x[8], unsigned int k) {
+  butterfly(x[0], x[4], k);
+  butterfly(x[1], x[5], k);
+  butterfly(x[2], x[6], k);
+  butterfly(x[3], x[7], k);
+  butterfly(x[0], x[2], 2 * k);
+  butterfly(x[1], x[3], 2 * k);
+  butterfly(x[4], x[6], 2 * k + 1);
+  butterfly(x[5], x[7], 2 * k + 1);
+  butterfly(x[0], x[1], 4 * k);
+  butterfly(x[2], x[3], 4 * k + 1);
+  butterfly(x[4], x[5], 4 * k + 2);
+  butterfly(x[6], x[7], 4 * k + 3);
+}
+
+/* Inverses of ntt_merge2 and ntt_merge3, len is that of the first layer, the
+ *   sums are reduced in the layer whose len is invntt_reduce_len, with last 
+ *   the third layer of ntt_merge3 is the scaled last layer of invntt */
+template <unsigned int len>
+MLKEM_ALWAYS_INLINE static inline void invntt_merge2(int16_t x[4], unsigned int k) {
+  constexpr bool r1 = len == invntt_reduce_len, r2 = 2 * len == invntt_reduce_len;
+  invbutterfly<r1>(x[0], x[1], 2 * k + 1);
+  invbutterfly<r1>(x[2], x[3], 2 * k);
+  invbutterfly<r2>(x[0], x[2], k);
+  invbutterfly<r2>(x[1], x[3], k);
+}
+
+template <unsigned int len, bool last = false>
+MLKEM_ALWAYS_INLINE static inline void invntt_merge3(int16_t x[8], unsigned int k) {
+  constexpr bool r1 = len == invntt_reduce_len, r2 = 2 * len == invntt_reduce_len, r3 = 4 * len == invntt_reduce_len;
+  invbutterfly<r1>(x[0], x[1], 4 * k + 3);
+  invbutterfly<r1>(x[2], x[3], 4 * k + 2);
+  invbutterfly<r1>(x[4], x[5], 4 * k + 1);
+  invbutterfly<r1>(x[6], x[7], 4 * k);
+  invbutterfly<r2>(x[0], x[2], 2 * k + 1);
+  invbutterfly<r2>(x[1], x[3], 2 * k + 1);
+  invbutterfly<r2>(x[4], x[6], 2 * k);
+  invbutterfly<r2>(x[5], x[7], 2 * k);
+  for (int m = 0; m < 4; ++m) {
+    if constexpr (last) { invbutterfly_last(x[m], x[m + 4]); } else { invbutterfly<r3>(x[m], x[m + 4], k); }
+  }
+}
+
+/* Scalar ntt in three passes instead of seven, layers len = 128, 64, 32 then
+ *   16, 8 then 4, 2 run merged on groups kept in registers, each coefficient 
+ *   sees the same butterflies in the same order as layer by layer, the inner 
+ *   loops of the first two passes run over contiguous coefficients so the 
+ *   compiler can still vectorize them
+ * */
+inline void ntt_scalar(int16_t v[256]) {
+  int16_t x[8];
+  for (int j = 0; j < 32; ++j) {
+    for (int m = 0; m < 8; ++m) { x[m] = v[j + 32 * m]; }
+    ntt_merge3(x, 1);
+    for (int m = 0; m < 8; ++m) { v[j + 32 * m] = x[m]; }
+  }
+  for (int i = 0; i < 8; ++i) {
+    for (int j = 0; j < 8; ++j) {
+      for (int m = 0; m < 4; ++m) { x[m] = v[32 * i + j + 8 * m]; }
+      ntt_merge2(x, 8 + i);
+      for (int m = 0; m < 4; ++m) { v[32 * i + j + 8 * m] = x[m]; }
+    }
+  }
+  for (int i = 0; i < 32; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      for (int m = 0; m < 4; ++m) { x[m] = v[8 * i + j + 2 * m]; }
+      ntt_merge2(x, 32 + i);
+      for (int m = 0; m < 4; ++m) { v[8 * i + j + 2 * m] = x[m]; }
+    }
+  }
+}
+
+/* Scalar invntt, the passes of ntt_scalar in reverse, the scaling by
+ *   mont^2/128 is merged into the twiddles of the last layer */
+inline void invntt_scalar(int16_t v[256]) {
+  int16_t x[8];
+  for (int i = 0; i < 32; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      for (int m = 0; m < 4; ++m) { x[m] = v[8 * i + j + 2 * m]; }
+      invntt_merge2<2>(x, 63 - i);
+      for (int m = 0; m < 4; ++m) { v[8 * i + j + 2 * m] = x[m]; }
+    }
+  }
+  for (int i = 0; i < 8; ++i) {
+    for (int j = 0; j < 8; ++j) {
+      for (int m = 0; m < 4; ++m) { x[m] = v[32 * i + j + 8 * m]; }
+      invntt_merge2<8>(x, 15 - i);
+      for (int m = 0; m < 4; ++m) { v[32 * i + j + 8 * m] = x[m]; }
+    }
+  }
+  for (int j = 0; j < 32; ++j) {
+    for (int m = 0; m < 8; ++m) { x[m] = v[j + 32 * m]; }
+    invntt_merge3<32, true>(x, 1);
+    for (int m = 0; m < 8; ++m) { v[j + 32 * m] = x[m]; }
+  }
+}
+
+#if MLKEM_HAS_AVX2
+
+/* Zetas of the last three ntt layers laid out in the lane order the avx2
+ * kernels shuffle the coefficients into, one row per 32 coefficients, the
+ * q suffixed rows hold their mont_qinv
+ *
+ *   len = 8: lanes [0, 8) and [8, 16) hold the two blocks of the chunk
+ *   len = 4: lanes are (blk 0, blk 2, blk 1, blk 3) 4 lanes each, as 
+ *     unpack_epi64 interleaves qwords of the two vectors
+ *   len = 2: each qword holds (blk m, blk m, blk 4+m, blk 4+m) as 2 lanes */
+typedef struct {
+  int16_t f8[8][16], f4[8][16], f2[8][16];
+  int16_t i2[8][16], i4[8][16], i8[8][16];
+  int16_t f8q[8][16], f4q[8][16], f2q[8][16];
+  int16_t i2q[8][16], i4q[8][16], i8q[8][16];
+} ntt_avx2_zetas_t;
+
+constexpr ntt_avx2_zetas_t make_ntt_avx2_zetas() {
+  ntt_avx2_zetas_t z{};
+  for (int i = 0; i < 8; ++i) {
+    for (int l = 0; l < 16; ++l) {
+      int b8 = l / 8;
+      int b4 = ((l / 4) & 1) * 2 + l / 8;
+      int b2 = (l / 4) + ((l / 2) & 1) * 4;
+      const unsigned int k[6] = { 16u + 2 * i + b8, 32u + 4 * i + b4, 64u + 8 * i + b2,
+        31u - (2 * i + b8), 63u - (4 * i + b4), 127u - (8 * i + b2) };
+      int16_t (*row[6])[16] = { z.f8, z.f4, z.f2, z.i8, z.i4, z.i2 };
+      int16_t (*rowq[6])[16] = { z.f8q, z.f4q, z.f2q, z.i8q, z.i4q, z.i2q };
+      for (int r = 0; r < 6; ++r) {
+        row[r][i][l] = ntt_plan.zetas[k[r]];
+        rowq[r][i][l] = ntt_plan.zetas_qinv[k[r]];
       }
     }
   }
+  return z;
 }
 
-inline void invntt(int16_t v[256]) {
-  unsigned int start, len, j, k = 127;
-  int16_t zeta, t;
-  const int16_t f = 1441; /* mont^2/128 */
-  for (len = 2; len <= 128; len <<= 1) {
-    for (start = 0; start < 256; start = j + len) {
-      zeta = zetas[k--];
-      for (j = start; j < start + len; ++j) {
-        t = v[j];
-        v[j] = barrett_reduce(t + v[j + len]);
-        v[j + len] = v[j + len] - t;
-        v[j + len] = fqmul(zeta, v[j + len]);
+alignas(32) inline constexpr ntt_avx2_zetas_t ntt_avx2_zetas = make_ntt_avx2_zetas();
+
+/* Same arithmetic as fqmul, the low halves of a*b and t*q are equal so
+ *   (a*b - t*q) >> 16 = hi(a*b) - hi(t*q) */
+MLKEM_TARGET_AVX2 static inline __m256i fqmul_avx2(__m256i a, __m256i b) {
+  __m256i lo = _mm256_mullo_epi16(a, b);
+  __m256i hi = _mm256_mulhi_epi16(a, b);
+  lo = _mm256_mullo_epi16(lo, _mm256_set1_epi16(mlkem_inverse_q));
+  lo = _mm256_mulhi_epi16(lo, _mm256_set1_epi16(mlkem_q));
+  return _mm256_sub_epi16(hi, lo);
+}
+
+/* Same arithmetic as fqmul_pre, the montgomery factor of b*z is the low half
+ *   of b*zq, one multiplication less than fqmul_avx2 */
+MLKEM_TARGET_AVX2 static inline __m256i fqmul_pre_avx2(__m256i b, __m256i z, __m256i zq) {
+  __m256i hi = _mm256_mulhi_epi16(b, z);
+  __m256i t = _mm256_mullo_epi16(b, zq);
+  t = _mm256_mulhi_epi16(t, _mm256_set1_epi16(mlkem_q));
+  return _mm256_sub_epi16(hi, t);
+}
+
+/* Same arithmetic as barrett_reduce, ((v*a >> 16) + 2^9) >> 10 equals
+ *   (v*a + 2^25) >> 26, mulhrs with 2^5 does the rounding shift */
+MLKEM_TARGET_AVX2 static inline __m256i barrett_reduce_avx2(__m256i a) {
+  const __m256i v = _mm256_set1_epi16(((1 << 26) + mlkem_q / 2) / mlkem_q);
+  __m256i t = _mm256_mulhi_epi16(a, v);
+  t = _mm256_mulhrs_epi16(t, _mm256_set1_epi16(1 << 5));
+  t = _mm256_mullo_epi16(t, _mm256_set1_epi16(mlkem_q));
+  return _mm256_sub_epi16(a, t);
+}
+
+MLKEM_TARGET_AVX2 static inline void butterfly_avx2(__m256i& a, __m256i& b, __m256i zeta, __m256i zeta_qinv) {
+  __m256i t = fqmul_pre_avx2(b, zeta, zeta_qinv);
+  b = _mm256_sub_epi16(a, t);
+  a = _mm256_add_epi16(a, t);
+}
+
+template <bool reduce>
+MLKEM_TARGET_AVX2 static inline void invbutterfly_avx2(__m256i& a, __m256i& b, __m256i zeta, __m256i zeta_qinv) {
+  __m256i t = a;
+  a = _mm256_add_epi16(t, b);
+  if constexpr (reduce) { a = barrett_reduce_avx2(a); }
+  b = fqmul_pre_avx2(_mm256_sub_epi16(b, t), zeta, zeta_qinv);
+}
+
+MLKEM_TARGET_AVX2 static inline void invbutterfly_last_avx2(__m256i& a, __m256i& b) {
+  __m256i t = a;
+  a = fqmul_pre_avx2(_mm256_add_epi16(t, b), _mm256_set1_epi16(ntt_plan.f), _mm256_set1_epi16(ntt_plan.f_qinv));
+  b = fqmul_pre_avx2(_mm256_sub_epi16(b, t), _mm256_set1_epi16(ntt_plan.fz), _mm256_set1_epi16(ntt_plan.fz_qinv));
+}
+
+/* Broadcast twiddle k of the plan and its mont_qinv */
+MLKEM_TARGET_AVX2 static inline void twiddle_avx2(__m256i& zeta, __m256i& zeta_qinv, unsigned int k) {
+  zeta = _mm256_set1_epi16(ntt_plan.zetas[k]);
+  zeta_qinv = _mm256_set1_epi16(ntt_plan.zetas_qinv[k]);
+}
+
+/* Row i of a shuffled zeta table */
+MLKEM_TARGET_AVX2 static inline __m256i row_avx2(const int16_t r[8][16], int i) {
+  return _mm256_load_si256((const __m256i*)r[i]);
+}
+
+/* Regroup two vectors so that the pairs of a butterfly with len = 8, 4, 2 sit
+ * in the same lane of x and y, each shuffle is its own inverse on (x, y) */
+MLKEM_TARGET_AVX2 static inline void shuffle8_avx2(__m256i& x, __m256i& y, __m256i a, __m256i b) {
+  x = _mm256_permute2x128_si256(a, b, 0x20);
+  y = _mm256_permute2x128_si256(a, b, 0x31);
+}
+
+MLKEM_TARGET_AVX2 static inline void shuffle4_avx2(__m256i& x, __m256i& y, __m256i a, __m256i b) {
+  x = _mm256_unpacklo_epi64(a, b);
+  y = _mm256_unpackhi_epi64(a, b);
+}
+
+MLKEM_TARGET_AVX2 static inline void shuffle2_avx2(__m256i& x, __m256i& y, __m256i a, __m256i b) {
+  x = _mm256_blend_epi32(a, _mm256_slli_epi64(b, 32), 0xaa);
+  y = _mm256_blend_epi32(_mm256_srli_epi64(a, 32), b, 0xaa);
+}
+
+static_assert(invntt_reduce_len >= 16 && invntt_reduce_len < 128, 
+  "the avx2 invntt reduces in the layers across vectors, the last one is scaled instead");
+
+/* Avx2 version of ntt, 16 coefficients per instruction, the first four layers 
+ * run across vectors, the last three inside a pair of vectors */
+MLKEM_TARGET_AVX2 inline void ntt_avx2(int16_t v[256]) {
+  unsigned int len, start, j, k = 1;
+  __m256i a, b, x, y, zeta, zeta_qinv;
+  const ntt_avx2_zetas_t& z = ntt_avx2_zetas;
+  for (len = 128; len >= 16; len >>= 1) {
+    for (start = 0; start < 256; start += 2 * len) {
+      twiddle_avx2(zeta, zeta_qinv, k++);
+      for (j = start; j < start + len; j += 16) {
+        a = _mm256_loadu_si256((const __m256i*)(v + j));
+        b = _mm256_loadu_si256((const __m256i*)(v + j + len));
+        butterfly_avx2(a, b, zeta, zeta_qinv);
+        _mm256_storeu_si256((__m256i*)(v + j), a);
+        _mm256_storeu_si256((__m256i*)(v + j + len), b);
+      }
+    }
+  }
+  for (int i = 0; i < 8; ++i) {
+    a = _mm256_loadu_si256((const __m256i*)(v + 32 * i));
+    b = _mm256_loadu_si256((const __m256i*)(v + 32 * i + 16));
+    shuffle8_avx2(x, y, a, b);
+    butterfly_avx2(x, y, row_avx2(z.f8, i), row_avx2(z.f8q, i));
+    shuffle8_avx2(a, b, x, y);
+    shuffle4_avx2(x, y, a, b);
+    butterfly_avx2(x, y, row_avx2(z.f4, i), row_avx2(z.f4q, i));
+    shuffle4_avx2(a, b, x, y);
+    shuffle2_avx2(x, y, a, b);
+    butterfly_avx2(x, y, row_avx2(z.f2, i), row_avx2(z.f2q, i));
+    shuffle2_avx2(a, b, x, y);
+    _mm256_storeu_si256((__m256i*)(v + 32 * i), a);
+    _mm256_storeu_si256((__m256i*)(v + 32 * i + 16), b);
+  }
+}
+
+MLKEM_TARGET_AVX2 inline void invntt_avx2(int16_t v[256]) {
+  unsigned int len, start, j, k = 15;
+  __m256i a, b, x, y, zeta, zeta_qinv;
+  const ntt_avx2_zetas_t& z = ntt_avx2_zetas;
+  for (int i = 0; i < 8; ++i) {
+    a = _mm256_loadu_si256((const __m256i*)(v + 32 * i));
+    b = _mm256_loadu_si256((const __m256i*)(v + 32 * i + 16));
+    shuffle2_avx2(x, y, a, b);
+    invbutterfly_avx2<false>(x, y, row_avx2(z.i2, i), row_avx2(z.i2q, i));
+    shuffle2_avx2(a, b, x, y);
+    shuffle4_avx2(x, y, a, b);
+    invbutterfly_avx2<false>(x, y, row_avx2(z.i4, i), row_avx2(z.i4q, i));
+    shuffle4_avx2(a, b, x, y);
+    shuffle8_avx2(x, y, a, b);
+    invbutterfly_avx2<false>(x, y, row_avx2(z.i8, i), row_avx2(z.i8q, i));
+    shuffle8_avx2(a, b, x, y);
+    _mm256_storeu_si256((__m256i*)(v + 32 * i), a);
+    _mm256_storeu_si256((__m256i*)(v + 32 * i + 16), b);
+  }
+  for (len = 16; len <= 64; len <<= 1) {
+    for (start = 0; start < 256; start += 2 * len) {
+      twiddle_avx2(zeta, zeta_qinv, k--);
+      for (j = start; j < start + len; j += 16) {
+        a = _mm256_loadu_si256((const __m256i*)(v + j));
+        b = _mm256_loadu_si256((const __m256i*)(v + j + len));
+        if (len == invntt_reduce_len) {
+          invbutterfly_avx2<true>(a, b, zeta, zeta_qinv);
+        } else {
+          invbutterfly_avx2<false>(a, b, zeta, zeta_qinv);
+        }
+        _mm256_storeu_si256((__m256i*)(v + j), a);
+        _mm256_storeu_si256((__m256i*)(v + j + len), b);
       }
     }
   }
-  for (j = 0; j < 256; ++j) {
-    v[j] = fqmul(v[j], f);
+  for (j = 0; j < 128; j += 16) { /* len = 128, scaled by mont^2/128 */
+    a = _mm256_loadu_si256((const __m256i*)(v + j));
+    b = _mm256_loadu_si256((const __m256i*)(v + j + 128));
+    invbutterfly_last_avx2(a, b);
+    _mm256_storeu_si256((__m256i*)(v + j), a);
+    _mm256_storeu_si256((__m256i*)(v + j + 128), b);
+  }
+}
+
+MLKEM_TARGET_AVX2 inline void reduce_avx2(int16_t v[256]) {
+  for (int j = 0; j < 256; j += 16) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(v + j));
+    _mm256_storeu_si256((__m256i*)(v + j), barrett_reduce_avx2(a));
   }
 }
 
-/* Multiplication in the ring Z_q[x]/(x^2-zeta)
+#endif /* MLKEM_HAS_AVX2 */
+
+/* Forward ntt, picks the avx2 kernel when the cpu has it, both produce the 
+ * same output bit by bit */
+inline void ntt(int16_t v[256]) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { ntt_avx2(v); return; }
+#endif
+  ntt_scalar(v);
+}
+
+/* Inverse ntt, lazily reduced, an input bounded by b gives an output bounded
+ *   by invntt_bound(b) */
+inline void invntt(int16_t v[256]) {
+  MLKEM_COUNT_REDUCE(128);
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { invntt_avx2(v); return; }
+#endif
+  invntt_scalar(v);
+}
+
+/* Multiplication in the ring Z_q[x]/(x^2-zeta) of pair i, zeta = gammas[i]
  *   where a(x) = a_0 + a_1x, b(x) = b_0 + b_1(x) 
  *   and a(x)b(x) = (a_0b_0) + (a_0b_1 + b_0a_1)x + (a_1b_1)x^2, x^2 = zeta
  */
-inline void basemul(int16_t p[2], const int16_t a[2], const int16_t b[2], int16_t zeta) {
+inline void basemul(int16_t p[2], const int16_t a[2], const int16_t b[2], unsigned int i) {
   p[0]  = fqmul(a[1], b[1]);
-  p[0]  = fqmul(p[0], zeta);
+  p[0]  = fqmul_pre(p[0], ntt_plan.gammas[i], ntt_plan.gammas_qinv[i]);
   p[0] += fqmul(a[0], b[0]);
   p[1]  = fqmul(a[0], b[1]);
   p[1] += fqmul(a[1], b[0]);
 }
 
+constexpr int32_t basemul_bound(int32_t ba, int32_t bb) {
+  int32_t m = fqmul_bound(ba, bb);
+  return max_bound(add_bound(fqmul_bound(m, zeta_bound), m), add_bound(m, m));
+}
+
 } /* namespace mlkem */
 
 #endif /* OPT_H */
\ No newline at end of file
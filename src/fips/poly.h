@@ -6,6 +6,7 @@
 #define POLY_H
 
 #include <cstdint>
+#include <cstring>
 
 #include "common.h"
 #include "opt.h"
@@ -18,6 +19,16 @@ typedef struct {
   int16_t coeffs[256];
 } poly;
 
+/* Bounds of the polys as they enter the arithmetic, see the bound functions
+ *   in opt.h
+ *
+ *   bytes_bound: 12 bit coefficients decoded from ek or dk 
+ *   uniform_bound: entries of the matrix, rejection sampled below q 
+ *   decompress_bound: decompressed cipher polys */
+constexpr int32_t bytes_bound = (1 << 12) - 1;
+constexpr int32_t uniform_bound = mlkem_q - 1;
+constexpr int32_t decompress_bound = mlkem_q;
+
 /* Pack 2 12-bits cofficients of a polynomial to 3 bytes */
 inline void poly_to_bytes(uint8_t out[poly_len], const poly* p) {
   uint16_t t0, t1;
@@ -41,6 +52,10 @@ inline void bytes_to_poly(poly* p, const uint8_t in[poly_len]) {
 }
 
 inline void poly_reduce(poly* p) {
+  MLKEM_COUNT_REDUCE(mlkem_n);
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { reduce_avx2(p->coeffs); return; }
+#endif
   for (int i = 0; i < mlkem_n; ++i) {
     p->coeffs[i] = barrett_reduce(p->coeffs[i]);
   }
@@ -53,9 +68,10 @@ inline void poly_tomont(poly* p) {
   }
 }
 
+/* Forward ntt, not reduced, an input bounded by b gives ntt_bound(b)
+ * */
 inline void poly_ntt(poly* p) {
   ntt(p->coeffs);
-  poly_reduce(p);
 }
 
 inline void poly_invntt(poly* p) {
@@ -75,22 +91,23 @@ inline void poly_sub(poly *p, const poly* a, const poly* b) {
 }
 
 inline void poly_basemul(poly* p, const poly* a, const poly* b) {
-  for (int i = 0; i < mlkem_n / 4; ++i) {
-    basemul(&p->coeffs[4 * i], &a->coeffs[4 * i], &b->coeffs[4 * i], zetas[64 + i]);
-    basemul(&p->coeffs[4 * i + 2], &a->coeffs[4 * i + 2], &b->coeffs[4 * i + 2], -zetas[64 + i]);
+  for (int i = 0; i < mlkem_n / 2; ++i) {
+    basemul(&p->coeffs[2 * i], &a->coeffs[2 * i], &b->coeffs[2 * i], i);
   }
 }
 
-/* Compress the polynomial into an array of bytes
+/* Compress the polynomial into an array of bytes, d bits per coefficient
  * 
  *   emlkem_quation: compress(x, d) = floor( (2^d/mlkem_q)*x + 1/2 )
  *   notice mult 40318 and then bit sr 27 is same as dividing by 3329
  */
-inline void poly_compress(uint8_t out[compressed_poly_len], const poly* p) {
-  int16_t u;
-  uint32_t d0;
-  uint8_t t[8];
-  if (compressed_poly_len == 128) {
+template <int d>
+inline void poly_compress_scalar(uint8_t out[d * mlkem_n / 8], const poly* p) {
+  static_assert(d == 4 || d == 5 || d == 10 || d == 11, "unsupported compression bits");
+  if constexpr (d == 4) {
+    int16_t u;
+    uint32_t d0;
+    uint8_t t[8];
     for (int i = 0; i < mlkem_n / 8; ++i) {
       for (int j = 0; j < 8; ++j) {
         u = p->coeffs[8 * i + j];
@@ -107,7 +124,10 @@ inline void poly_compress(uint8_t out[compressed_poly_len], const poly* p) {
       out[3] = t[6] | (t[7] << 4);
       out += 4;
     }
-  } else if (compressed_poly_len == 160) {
+  } else if constexpr (d == 5) {
+    int16_t u;
+    uint32_t d0;
+    uint8_t t[8];
     for (int i = 0; i < mlkem_n / 8; ++i) {
       for (int j = 0; j < 8; ++j) {
         u  = p->coeffs[8 * i + j];
@@ -125,20 +145,67 @@ inline void poly_compress(uint8_t out[compressed_poly_len], const poly* p) {
       out[4] = (t[6] >> 2) | (t[7] << 3);
       out += 5;
     }
+  } else if constexpr (d == 10) {
+    uint64_t d0;
+    uint16_t t[4];
+    for (int j = 0; j < mlkem_n / 4; ++j) {
+      for (int m = 0; m < 4; ++m) {
+        t[m] = p->coeffs[4 * j + m];
+        t[m] += ((int16_t)t[m] >> 15) & mlkem_q;
+        d0 = t[m];
+        d0 <<= 10;
+        d0 += 1665;
+        d0 *= 1290167;
+        d0 >>= 32;
+        t[m] = d0 & 0x3ff;
+      }
+      out[0] = (t[0] >> 0);
+      out[1] = (t[0] >> 8) | (t[1] << 2);
+      out[2] = (t[1] >> 6) | (t[2] << 4);
+      out[3] = (t[2] >> 4) | (t[3] << 6);
+      out[4] = (t[3] >> 2);
+      out += 5;
+    }
   } else {
-    // todo
+    uint64_t d0;
+    uint16_t t[8];
+    for (int j = 0; j < mlkem_n / 8; ++j) {
+      for (int m = 0; m < 8; ++m) {
+        t[m] = p->coeffs[8 * j + m];
+        t[m] += ((int16_t)t[m] >> 15) & mlkem_q;
+        d0 = t[m];
+        d0 <<= 11;
+        d0 += 1664;
+        d0 *= 645084;
+        d0 >>= 31;
+        t[m] = d0 & 0x7ff;
+      }
+      out[0] = (t[0] >> 0);
+      out[1] = (t[0] >> 8) | (t[1] << 3);
+      out[2] = (t[1] >> 5) | (t[2] << 6);
+      out[3] = (t[2] >> 2);
+      out[4] = (t[2] >> 10) | (t[3] << 1);
+      out[5] = (t[3] >> 7) | (t[4] << 4);
+      out[6] = (t[4] >> 4) | (t[5] << 7);
+      out[7] = (t[5] >> 1);
+      out[8] = (t[5] >> 9) | (t[6] << 2);
+      out[9] = (t[6] >> 6) | (t[7] << 5);
+      out[10] = (t[7] >>  3);
+      out += 11;
+    }
   }
 }
 
-inline void poly_decompress(poly* p, const uint8_t in[compressed_poly_len]) {
-  if (compressed_poly_len == 128) {
+template <int d>
+inline void poly_decompress_scalar(poly* p, const uint8_t in[d * mlkem_n / 8]) {
+  static_assert(d == 4 || d == 5 || d == 10 || d == 11, "unsupported compression bits");
+  if constexpr (d == 4) {
     for (int i = 0; i < mlkem_n / 2 ; ++i) {
       p->coeffs[2 * i + 0] = (((uint16_t)(in[0] & 15) * mlkem_q) + 8) >> 4;
       p->coeffs[2 * i + 1] = (((uint16_t)(in[0] >> 4) * mlkem_q) + 8) >> 4;
       in += 1;
     }
-  } else if (compressed_poly_len == 160) {
-    unsigned int j;
+  } else if constexpr (d == 5) {
     uint8_t t[8];
     for (int i = 0; i < mlkem_n / 8; ++i) {
       t[0] = (in[0] >> 0);
@@ -154,12 +221,36 @@ inline void poly_decompress(poly* p, const uint8_t in[compressed_poly_len]) {
         p->coeffs[8*i+j] = ((uint32_t)(t[j] & 31) * mlkem_q + 16) >> 5;
       }
     }
+  } else if constexpr (d == 10) {
+    uint16_t t[4];
+    for(int j = 0; j < mlkem_n / 4; ++j) {
+      t[0] = (in[0] >> 0) | ((uint16_t)in[1] << 8);
+      t[1] = (in[1] >> 2) | ((uint16_t)in[2] << 6);
+      t[2] = (in[2] >> 4) | ((uint16_t)in[3] << 4);
+      t[3] = (in[3] >> 6) | ((uint16_t)in[4] << 2);
+      in += 5;
+      for(int m = 0; m < 4; ++m)
+        p->coeffs[4*j+m] = ((uint32_t)(t[m] & 0x3ff) * mlkem_q + 512) >> 10;
+    }
   } else {
-    // todo
+    uint16_t t[8];
+    for(int j = 0; j < mlkem_n / 8; ++j) {
+      t[0] = (in[0] >> 0) | ((uint16_t)in[ 1] << 8);
+      t[1] = (in[1] >> 3) | ((uint16_t)in[ 2] << 5);
+      t[2] = (in[2] >> 6) | ((uint16_t)in[ 3] << 2) | ((uint16_t)in[4] << 10);
+      t[3] = (in[4] >> 1) | ((uint16_t)in[ 5] << 7);
+      t[4] = (in[5] >> 4) | ((uint16_t)in[ 6] << 4);
+      t[5] = (in[6] >> 7) | ((uint16_t)in[ 7] << 1) | ((uint16_t)in[8] << 9);
+      t[6] = (in[8] >> 2) | ((uint16_t)in[ 9] << 6);
+      t[7] = (in[9] >> 5) | ((uint16_t)in[10] << 3);
+      in += 11;
+      for(int m = 0; m < 8; ++m)
+        p->coeffs[8*j+m] = ((uint32_t)(t[m] & 0x7ff) * mlkem_q + 1024) >> 11;
+    }
   }
 }
 
-inline void poly_to_msg(uint8_t m[msg_len], const poly *p) {
+inline void poly_to_msg_scalar(uint8_t m[msg_len], const poly *p) {
   uint32_t t;
   for (int i = 0; i < mlkem_n / 8; ++i) {
     m[i] = 0;
@@ -175,7 +266,7 @@ inline void poly_to_msg(uint8_t m[msg_len], const poly *p) {
   }
 }
 
-inline void msg_to_poly(poly* p, const uint8_t m[msg_len]) {
+inline void msg_to_poly_scalar(poly* p, const uint8_t m[msg_len]) {
   for (int i = 0; i < mlkem_n / 8; ++i) {
     for (int j = 0; j < 8; ++j) {
       p->coeffs[8 * i + j] = 0;
@@ -184,142 +275,369 @@ inline void msg_to_poly(poly* p, const uint8_t m[msg_len]) {
   }
 }
 
+#if MLKEM_HAS_AVX2
+
+/* Compress 16 coefficients, the scalar formula of poly_compress_scalar in 32 
+ *   bit lanes (64 bit products for d = 10, 11) so every input, in range or 
+ *   not, gives the same value, returned as 16 bit lanes in order */
+template <int d>
+MLKEM_TARGET_AVX2 static inline __m256i compress16_avx2(__m256i x) {
+  const __m256i mask = _mm256_set1_epi32((1 << d) - 1);
+  __m256i u, v[2];
+  u = _mm256_add_epi16(x, _mm256_and_si256(_mm256_srai_epi16(x, 15), _mm256_set1_epi16(mlkem_q)));
+  if constexpr (d == 4 || d == 5) {
+    const __m256i c = _mm256_set1_epi32(d == 4 ? 1665 : 1664);
+    const __m256i m = _mm256_set1_epi32(d == 4 ? 80635 : 40318);
+    v[0] = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(u));
+    v[1] = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(u, 1));
+    for (int h = 0; h < 2; ++h) {
+      v[h] = _mm256_add_epi32(_mm256_slli_epi32(v[h], d), c);
+      v[h] = _mm256_srli_epi32(_mm256_mullo_epi32(v[h], m), d == 4 ? 28 : 27);
+    }
+  } else {
+    const __m256i c = _mm256_set1_epi32(d == 10 ? 1665 : 1664);
+    const __m256i m = _mm256_set1_epi32(d == 10 ? 1290167 : 645084);
+    constexpr int sh = d == 10 ? 32 : 31;
+    __m256i e, o;
+    v[0] = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(u));
+    v[1] = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(u, 1));
+    for (int h = 0; h < 2; ++h) {
+      v[h] = _mm256_add_epi32(_mm256_slli_epi32(v[h], d), c);
+      e = _mm256_srli_epi64(_mm256_mul_epu32(v[h], m), sh);
+      o = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(v[h], 32), m), sh);
+      v[h] = _mm256_blend_epi32(e, _mm256_slli_epi64(o, 32), 0xaa);
+    }
+  }
+  v[0] = _mm256_and_si256(v[0], mask);
+  v[1] = _mm256_and_si256(v[1], mask);
+  return _mm256_permute4x64_epi64(_mm256_packus_epi32(v[0], v[1]), 0xd8);
+}
+
+/* Pack 16 values of d bits, each 128 bit lane ends up with its 8 values in 
+ *   bytes [0, d), pairs are merged in 32 bit lanes, then 64, then 128 */
+template <int d>
+MLKEM_TARGET_AVX2 static inline __m256i pack16_avx2(__m256i x) {
+  __m256i s;
+  x = _mm256_madd_epi16(x, _mm256_set1_epi32((1 << d << 16) | 1));
+  x = _mm256_sllv_epi32(x, _mm256_set1_epi64x(32 - 2 * d));
+  x = _mm256_srli_epi64(x, 32 - 2 * d);
+  s = _mm256_bsrli_epi128(x, 8);
+  x = _mm256_or_si256(x, _mm256_slli_epi64(s, 4 * d));
+  return _mm256_unpacklo_epi64(x, _mm256_srli_epi64(s, 64 - 4 * d));
+}
+
+/* Byte gather and shift to unpack d bit values, for d <= 8 each 16 bit lane
+ *   takes two bytes and is shifted up by mul then down by 16 - d, for d > 8 
+ *   each 32 bit lane takes three bytes and is shifted down by shift */
 typedef struct {
-  poly vec[mlkem_k];
-} poly_vec;
+  alignas(32) int8_t idx[32];
+  alignas(32) int16_t mul[16];
+  alignas(32) int32_t shift[8];
+} unpack_avx2_table_t;
+
+constexpr unpack_avx2_table_t make_unpack_avx2_table(int d) {
+  unpack_avx2_table_t t{};
+  if (d <= 8) {
+    for (int j = 0; j < 16; ++j) {
+      t.idx[2 * j] = (int8_t)(d * j / 8);
+      t.idx[2 * j + 1] = (int8_t)(d * j / 8 + 1);
+      t.mul[j] = (int16_t)(1 << (16 - d - d * j % 8));
+    }
+  } else {
+    for (int j = 0; j < 8; ++j) {
+      for (int b = 0; b < 3; ++b) { t.idx[4 * j + b] = (int8_t)(d * j / 8 + b); }
+      t.idx[4 * j + 3] = -1;
+      t.shift[j] = d * j % 8;
+    }
+  }
+  return t;
+}
+
+template <int d>
+inline constexpr unpack_avx2_table_t unpack_avx2_table = make_unpack_avx2_table(d);
+
+/* Unpack 16 values of d bits from bytes [0, 2 d) of in as 16 bit lanes, in 
+ *   must have 16 readable bytes, or d + 16 when d > 8 */
+template <int d>
+MLKEM_TARGET_AVX2 static inline __m256i unpack16_avx2(const uint8_t* in) {
+  const unpack_avx2_table_t& t = unpack_avx2_table<d>;
+  const __m256i idx = _mm256_load_si256((const __m256i*)t.idx);
+  __m256i x, y;
+  if constexpr (d <= 8) {
+    x = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)in));
+    x = _mm256_mullo_epi16(_mm256_shuffle_epi8(x, idx), _mm256_load_si256((const __m256i*)t.mul));
+    return _mm256_srli_epi16(x, 16 - d);
+  } else {
+    const __m256i shift = _mm256_load_si256((const __m256i*)t.shift);
+    const __m256i mask = _mm256_set1_epi32((1 << d) - 1);
+    x = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)in));
+    y = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(in + d)));
+    x = _mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(x, idx), shift), mask);
+    y = _mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(y, idx), shift), mask);
+    return _mm256_permute4x64_epi64(_mm256_packus_epi32(x, y), 0xd8);
+  }
+}
+
+/* Blocks of 16 coefficients whose 16 byte accesses, which end up to reach
+ *   bytes past the block start, stay inside the d bit encoding, the rest go
+ *   through a buffer */
+constexpr int direct_blocks(int d, int reach) { return (d * mlkem_n / 8 - reach) / (2 * d) + 1; }
+
+/* Avx2 versions of poly_compress and poly_decompress, same output as the
+ *   scalar code */
+template <int d>
+MLKEM_TARGET_AVX2 inline void poly_compress_avx2(uint8_t out[d * mlkem_n / 8], const poly* p) {
+  constexpr int n = direct_blocks(d, d + 16);
+  uint8_t buf[(mlkem_n / 16 - n) * 2 * d + 16];
+  uint8_t* r;
+  __m256i x;
+  for (int i = 0; i < mlkem_n / 16; ++i) {
+    r = (i < n) ? out + 2 * d * i : buf + 2 * d * (i - n);
+    x = _mm256_loadu_si256((const __m256i*)(p->coeffs + 16 * i));
+    x = pack16_avx2<d>(compress16_avx2<d>(x));
+    _mm_storeu_si128((__m128i*)r, _mm256_castsi256_si128(x));
+    _mm_storeu_si128((__m128i*)(r + d), _mm256_extracti128_si256(x, 1));
+  }
+  memcpy(out + 2 * d * n, buf, (mlkem_n / 16 - n) * 2 * d);
+}
+
+template <int d>
+MLKEM_TARGET_AVX2 inline void poly_decompress_avx2(poly* p, const uint8_t in[d * mlkem_n / 8]) {
+  constexpr int n = direct_blocks(d, d <= 8 ? 16 : d + 16);
+  uint8_t buf[(mlkem_n / 16 - n) * 2 * d + 16] = {};
+  const __m256i q = _mm256_set1_epi16(mlkem_q);
+  __m256i x;
+  memcpy(buf, in + 2 * d * n, (mlkem_n / 16 - n) * 2 * d);
+  for (int i = 0; i < mlkem_n / 16; ++i) {
+    x = unpack16_avx2<d>((i < n) ? in + 2 * d * i : buf + 2 * d * (i - n));
+    /* (x q + 2^(d-1)) >> d as a rounding high product of x 2^(15-d) and q */
+    x = _mm256_mulhrs_epi16(_mm256_slli_epi16(x, 15 - d), q);
+    _mm256_storeu_si256((__m256i*)(p->coeffs + 16 * i), x);
+  }
+}
 
-inline void poly_vec_to_bytes(const poly_vec* pv, uint8_t* out) {
-  for (int i = 0; i < mlkem_k; ++i) {
+/* Avx2 version of poly_to_msg, the scalar formula in 32 bit lanes, shifted so
+ *   the bit of each coefficient is the lane sign for movemask */
+MLKEM_TARGET_AVX2 inline void poly_to_msg_avx2(uint8_t m[msg_len], const poly* p) {
+  const __m256i c = _mm256_set1_epi32(1665);
+  const __m256i f = _mm256_set1_epi32(80635);
+  __m256i t;
+  for (int i = 0; i < mlkem_n / 8; ++i) {
+    t = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(p->coeffs + 8 * i)));
+    t = _mm256_add_epi32(_mm256_slli_epi32(t, 1), c);
+    t = _mm256_slli_epi32(_mm256_mullo_epi32(t, f), 3);
+    m[i] = (uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(t));
+  }
+}
+
+/* Avx2 version of msg_to_poly, constant time as the scalar cmov */
+MLKEM_TARGET_AVX2 inline void msg_to_poly_avx2(poly* p, const uint8_t m[msg_len]) {
+  const __m256i bits = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128,
+    256, 512, 1024, 2048, 4096, 8192, 16384, (int16_t)0x8000);
+  const __m256i h = _mm256_set1_epi16((mlkem_q + 1) / 2);
+  __m256i x;
+  for (int i = 0; i < mlkem_n / 16; ++i) {
+    x = _mm256_set1_epi16((int16_t)(m[2 * i] | m[2 * i + 1] << 8));
+    x = _mm256_cmpeq_epi16(_mm256_and_si256(x, bits), bits);
+    _mm256_storeu_si256((__m256i*)(p->coeffs + 16 * i), _mm256_and_si256(x, h));
+  }
+}
+
+#endif /* MLKEM_HAS_AVX2 */
+
+/* Compress and decompress with d bits per coefficient, and the msg encoding,
+ *   pick the avx2 kernels when the cpu has them, both give the same bytes
+ * */
+template <int d>
+inline void poly_compress(uint8_t out[d * mlkem_n / 8], const poly* p) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { poly_compress_avx2<d>(out, p); return; }
+#endif
+  poly_compress_scalar<d>(out, p);
+}
+
+template <int d>
+inline void poly_decompress(poly* p, const uint8_t in[d * mlkem_n / 8]) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { poly_decompress_avx2<d>(p, in); return; }
+#endif
+  poly_decompress_scalar<d>(p, in);
+}
+
+inline void poly_to_msg(uint8_t m[msg_len], const poly* p) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { poly_to_msg_avx2(m, p); return; }
+#endif
+  poly_to_msg_scalar(m, p);
+}
+
+inline void msg_to_poly(poly* p, const uint8_t m[msg_len]) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { msg_to_poly_avx2(p, m); return; }
+#endif
+  msg_to_poly_scalar(p, m);
+}
+
+/* A vector of mlkem_k polynomials, k depends on the parameter set P */
+template <typename P>
+struct poly_vec {
+  poly vec[P::mlkem_k];
+};
+
+template <typename P>
+inline void poly_vec_to_bytes(const poly_vec<P>* pv, uint8_t* out) {
+  for (int i = 0; i < P::mlkem_k; ++i) {
     poly_to_bytes(out + i * poly_len, &pv->vec[i]);
   }
 }
 
-inline void bytes_to_poly_vec(const uint8_t* in, poly_vec* pv) {
-  for (int i = 0; i < mlkem_k; ++i) {
+template <typename P>
+inline void bytes_to_poly_vec(const uint8_t* in, poly_vec<P>* pv) {
+  for (int i = 0; i < P::mlkem_k; ++i) {
     bytes_to_poly(&pv->vec[i], in + i * poly_len);
   }
 }
 
-inline void poly_vec_reduce(poly_vec* pv) {
-  for (int i = 0; i < mlkem_k; ++i) {
+template <typename P>
+inline void poly_vec_reduce(poly_vec<P>* pv) {
+  for (int i = 0; i < P::mlkem_k; ++i) {
     poly_reduce(&pv->vec[i]);
   }
 }
 
-inline void poly_vec_ntt(poly_vec* pv) {
-  for (int i = 0; i < mlkem_k; ++i) {
+template <typename P>
+inline void poly_vec_ntt(poly_vec<P>* pv) {
+  for (int i = 0; i < P::mlkem_k; ++i) {
     poly_ntt(&pv->vec[i]);
   }
 }
 
-inline void poly_vec_invntt(poly_vec* pv) {
-  for (int i = 0; i < mlkem_k; ++i) {
+template <typename P>
+inline void poly_vec_invntt(poly_vec<P>* pv) {
+  for (int i = 0; i < P::mlkem_k; ++i) {
     poly_invntt(&pv->vec[i]);
   }
 }
 
-inline void poly_vec_add(poly_vec* pv, const poly_vec* a, const poly_vec* b) {
-  for (int i = 0; i < mlkem_k; ++i) {
+template <typename P>
+inline void poly_vec_add(poly_vec<P>* pv, const poly_vec<P>* a, const poly_vec<P>* b) {
+  for (int i = 0; i < P::mlkem_k; ++i) {
     poly_add(&pv->vec[i], &a->vec[i], &b->vec[i]);
   }
 }
 
-inline void poly_vec_basemul(poly* p, const poly_vec* a, const poly_vec* b) {
-  poly t;
-  poly_basemul(p, &a->vec[0], &b->vec[0]);
-  for (int i = 1; i < mlkem_k; ++i) {
-    poly_basemul(&t, &a->vec[i], &b->vec[i]);
-    poly_add(p, p, &t);
+/* Bound of the int32 sums poly_vec_basemul accumulates per coefficient from 
+ *   inputs bounded by ba and bb, the montgomery reduction needs them below
+ *   2^31 - 2^15 q, its output is then barrett reduced to barrett_bound */
+template <typename P>
+constexpr int64_t poly_vec_basemul_acc_bound(int32_t ba, int32_t bb) {
+  if (!fits_int16(ba) || !fits_int16(bb)) { return INT64_MAX; }
+  int64_t r0 = (int64_t)ba * bb + (int64_t)fqmul_bound(ba, bb) * zeta_bound;
+  int64_t r1 = 2 * (int64_t)ba * bb;
+  return P::mlkem_k * (r0 > r1 ? r0 : r1);
+}
+
+constexpr bool fits_montgomery(int64_t a) {
+  return a <= INT32_MAX - ((int64_t)mlkem_q << 15);
+}
+
+/* Inner product of two vectors in the ntt domain, the k products of each 
+ *   coefficient are summed in int32 and montgomery reduced once, only a1*b1 is
+ *   reduced before its multiplication by zeta, no temporary poly
+ * */
+template <typename P>
+inline void poly_vec_basemul(poly* p, const poly_vec<P>* a, const poly_vec<P>* b) {
+  int32_t r0, r1, r2, r3;
+  const int16_t *x, *y;
+  for (int j = 0; j < mlkem_n / 4; ++j) {
+    const int16_t g0 = ntt_plan.gammas[2 * j], g1 = ntt_plan.gammas[2 * j + 1];
+    r0 = r1 = r2 = r3 = 0;
+    for (int i = 0; i < P::mlkem_k; ++i) {
+      x = &a->vec[i].coeffs[4 * j];
+      y = &b->vec[i].coeffs[4 * j];
+      r0 += (int32_t)x[0] * y[0] + (int32_t)fqmul(x[1], y[1]) * g0;
+      r1 += (int32_t)x[0] * y[1] + (int32_t)x[1] * y[0];
+      r2 += (int32_t)x[2] * y[2] + (int32_t)fqmul(x[3], y[3]) * g1;
+      r3 += (int32_t)x[2] * y[3] + (int32_t)x[3] * y[2];
+    }
+    p->coeffs[4 * j + 0] = montgomery_reduce(r0);
+    p->coeffs[4 * j + 1] = montgomery_reduce(r1);
+    p->coeffs[4 * j + 2] = montgomery_reduce(r2);
+    p->coeffs[4 * j + 3] = montgomery_reduce(r3);
   }
   poly_reduce(p);
 }
 
-inline void poly_vec_compress(uint8_t out[compressed_poly_vec_len], const poly_vec* p) {
-  uint64_t d0;
-  if (compressed_poly_vec_len == mlkem_k * 352) {
-    uint16_t t[8];
-    for (int i = 0; i < mlkem_k; ++i) {
-      for (int j = 0; j < mlkem_n / 8; ++j) {
-        for (int m = 0; m < 8; ++m) {
-          t[m] = p->vec[i].coeffs[8 * j + m];
-          t[m] += ((int16_t)t[m] >> 15) & mlkem_q;
-          d0 = t[m];
-          d0 <<= 11;
-          d0 += 1664;
-          d0 *= 645084;
-          d0 >>= 31;
-          t[m] = d0 & 0x7ff;
-        }
-        out[0] = (t[0] >> 0);
-        out[1] = (t[0] >> 8) | (t[1] << 3);
-        out[2] = (t[1] >> 5) | (t[2] << 6);
-        out[3] = (t[2] >> 2);
-        out[4] = (t[2] >> 10) | (t[3] << 1);
-        out[5] = (t[3] >> 7) | (t[4] << 4);
-        out[6] = (t[4] >> 4) | (t[5] << 7);
-        out[7] = (t[5] >> 1);
-        out[8] = (t[5] >> 9) | (t[6] << 2);
-        out[9] = (t[6] >> 6) | (t[7] << 5);
-        out[10] = (t[7] >>  3);
-        out += 11;
-      }
-    }
-  } else if (compressed_poly_vec_len == mlkem_k * 320) {
-    uint16_t t[4];
-    for(int i=0; i < mlkem_k; ++i) {
-      for(int j = 0; j < mlkem_n / 4; ++j) {
-        for(int m = 0; m < 4; ++m) {
-          t[m] = p->vec[i].coeffs[4 * j + m];
-          t[m] += ((int16_t)t[m] >> 15) & mlkem_q;
-          d0 = t[m];
-          d0 <<= 10;
-          d0 += 1665;
-          d0 *= 1290167;
-          d0 >>= 32;
-          t[m] = d0 & 0x3ff;
-        }
-        out[0] = (t[0] >> 0);
-        out[1] = (t[0] >> 8) | (t[1] << 2);
-        out[2] = (t[1] >> 6) | (t[2] << 4);
-        out[3] = (t[2] >> 4) | (t[3] << 6);
-        out[4] = (t[3] >> 2);
-        out += 5;
-      }
-    }
+/* Multiplication cache of a poly in the ntt domain, b_1 * zeta of each of its
+ *   coefficient pairs, reduced, so a basemul against it needs no montgomery
+ *   product for the x^2 term, worth it for an operand used against several 
+ *   rows (y and s against A) or kept with a key */
+typedef struct {
+  int16_t coeffs[mlkem_n / 2];
+} poly_mulcache;
+
+template <typename P>
+struct poly_vec_mulcache {
+  poly_mulcache vec[P::mlkem_k];
+};
+
+inline void poly_mulcache_compute(poly_mulcache* c, const poly* b) {
+  for (int i = 0; i < mlkem_n / 2; ++i) {
+    c->coeffs[i] = fqmul_pre(b->coeffs[2 * i + 1], ntt_plan.gammas[i], ntt_plan.gammas_qinv[i]);
   }
 }
 
-inline void poly_vec_decompress(poly_vec* p, const uint8_t in[compressed_poly_vec_len]) {
-  if (compressed_poly_vec_len == mlkem_k * 352) {
-    uint16_t t[8];
-    for(int i = 0; i < mlkem_k; ++i) {
-      for(int j = 0; j < mlkem_n / 8; ++j) {
-        t[0] = (in[0] >> 0) | ((uint16_t)in[ 1] << 8);
-        t[1] = (in[1] >> 3) | ((uint16_t)in[ 2] << 5);
-        t[2] = (in[2] >> 6) | ((uint16_t)in[ 3] << 2) | ((uint16_t)in[4] << 10);
-        t[3] = (in[4] >> 1) | ((uint16_t)in[ 5] << 7);
-        t[4] = (in[5] >> 4) | ((uint16_t)in[ 6] << 4);
-        t[5] = (in[6] >> 7) | ((uint16_t)in[ 7] << 1) | ((uint16_t)in[8] << 9);
-        t[6] = (in[8] >> 2) | ((uint16_t)in[ 9] << 6);
-        t[7] = (in[9] >> 5) | ((uint16_t)in[10] << 3);
-        in += 11;
-        for(int m = 0; m < 8; ++m)
-          p->vec[i].coeffs[8*j+m] = ((uint32_t)(t[m] & 0x7ff) * mlkem_q + 1024) >> 11;
-      }
-    }
-  } else if (compressed_poly_vec_len == mlkem_k * 320) {
-    uint16_t t[4];
-    for(int i = 0; i < mlkem_k; ++i) {
-      for(int j = 0; j < mlkem_n / 4; ++j) {
-        t[0] = (in[0] >> 0) | ((uint16_t)in[1] << 8);
-        t[1] = (in[1] >> 2) | ((uint16_t)in[2] << 6);
-        t[2] = (in[2] >> 4) | ((uint16_t)in[3] << 4);
-        t[3] = (in[3] >> 6) | ((uint16_t)in[4] << 2);
-        in += 5;
-        for(int m = 0; m < 4; ++m)
-          p->vec[i].coeffs[4*j+m] = ((uint32_t)(t[m] & 0x3ff) * mlkem_q + 512) >> 10;
-      }
+template <typename P>
+inline void poly_vec_mulcache_compute(poly_vec_mulcache<P>* c, const poly_vec<P>* b) {
+  for (int i = 0; i < P::mlkem_k; ++i) { poly_mulcache_compute(&c->vec[i], &b->vec[i]); }
+}
+
+/* As poly_vec_basemul_acc_bound with b cached, the cache of an input bounded
+ *   by bb is bounded by fqmul_bound(bb, zeta_bound) */
+template <typename P>
+constexpr int64_t poly_vec_basemul_cached_acc_bound(int32_t ba, int32_t bb) {
+  if (!fits_int16(ba) || !fits_int16(bb)) { return INT64_MAX; }
+  int64_t r0 = (int64_t)ba * bb + (int64_t)ba * fqmul_bound(bb, zeta_bound);
+  int64_t r1 = 2 * (int64_t)ba * bb;
+  return P::mlkem_k * (r0 > r1 ? r0 : r1);
+}
+
+/* poly_vec_basemul with bc the cache of b, the sums are congruent to those of
+ *   poly_vec_basemul and, as both are barrett reduced, so is the output */
+template <typename P>
+inline void poly_vec_basemul(poly* p, const poly_vec<P>* a, const poly_vec<P>* b, const poly_vec_mulcache<P>* bc) {
+  int32_t r0, r1, r2, r3;
+  const int16_t *x, *y, *c;
+  for (int j = 0; j < mlkem_n / 4; ++j) {
+    r0 = r1 = r2 = r3 = 0;
+    for (int i = 0; i < P::mlkem_k; ++i) {
+      x = &a->vec[i].coeffs[4 * j];
+      y = &b->vec[i].coeffs[4 * j];
+      c = &bc->vec[i].coeffs[2 * j];
+      r0 += (int32_t)x[0] * y[0] + (int32_t)x[1] * c[0];
+      r1 += (int32_t)x[0] * y[1] + (int32_t)x[1] * y[0];
+      r2 += (int32_t)x[2] * y[2] + (int32_t)x[3] * c[1];
+      r3 += (int32_t)x[2] * y[3] + (int32_t)x[3] * y[2];
     }
+    p->coeffs[4 * j + 0] = montgomery_reduce(r0);
+    p->coeffs[4 * j + 1] = montgomery_reduce(r1);
+    p->coeffs[4 * j + 2] = montgomery_reduce(r2);
+    p->coeffs[4 * j + 3] = montgomery_reduce(r3);
+  }
+  poly_reduce(p);
+}
+
+template <typename P>
+inline void poly_vec_compress(uint8_t out[P::compressed_poly_vec_len], const poly_vec<P>* p) {
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    poly_compress<P::mlkem_du>(out + i * P::mlkem_du * mlkem_n / 8, &p->vec[i]);
+  }
+}
+
+template <typename P>
+inline void poly_vec_decompress(poly_vec<P>* p, const uint8_t in[P::compressed_poly_vec_len]) {
+  for (int i = 0; i < P::mlkem_k; ++i) {
+    poly_decompress<P::mlkem_du>(&p->vec[i], in + i * P::mlkem_du * mlkem_n / 8);
   }
 }
 
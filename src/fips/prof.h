@@ -0,0 +1,120 @@
+/* Copyright 2026, Yao Zeran, Zhang Chenzhi
+ *
+ * The <prof.h> file defines optional per-stage cycle counters for key gen,
+ *   encap and decap. Define MLKEM_STAGE_PROFILE to turn them on, otherwise
+ *   MLKEM_STAGE expands to nothing and the counters stay zero. */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(MLKEM_STAGE_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif defined(MLKEM_STAGE_PROFILE)
+#include <chrono>
+#endif
+
+namespace mlkem
+{
+
+/* Stages are inclusive, e.g. indcpa_enc also counts the gen_noise it runs
+ * */
+enum class stage {
+  rand,           /* gen_rand_bytes */
+  hash_h,         /* sha3_256 of the encapsulation key */
+  hash_g,         /* sha3_512 G step, also the seed expansion in key gen */
+  gen_matrix,     /* A or A^T from the public seed */
+  gen_noise,      /* prf and cbd of the noise polys */
+  indcpa_key_gen,
+  indcpa_enc,     /* includes the re-encryption in decap */
+  indcpa_dec,
+  rkprf,          /* implicit rejection key J(z, c) */
+  count
+};
+
+constexpr int stage_count = (int)stage::count;
+
+constexpr bool stage_profile_enabled =
+#ifdef MLKEM_STAGE_PROFILE
+  true;
+#else
+  false;
+#endif
+
+/* Counters of the calling thread, cycles are tsc ticks (ns where there is no
+ *   tsc), reductions counts coefficients passed through barrett_reduce */
+typedef struct {
+  uint64_t cycles[stage_count];
+  uint64_t calls[stage_count];
+  uint64_t reductions;
+} stage_counters;
+
+inline const char* stage_name(stage s) {
+  static const char* const names[stage_count] = {
+    "rand", "hash_h", "hash_g", "gen_matrix", "gen_noise",
+    "indcpa_key_gen", "indcpa_enc", "indcpa_dec", "rkprf"
+  };
+  return (int)s < stage_count ? names[(int)s] : "?";
+}
+
+inline stage_counters* thread_stage_counters() {
+  static thread_local stage_counters c;
+  return &c;
+}
+
+/* Copy the calling thread's counters to out
+ * */
+inline void stage_snapshot(stage_counters* out) {
+  memcpy(out, thread_stage_counters(), sizeof(stage_counters));
+}
+
+/* Zero the calling thread's counters
+ * */
+inline void stage_reset() {
+  memset(thread_stage_counters(), 0, sizeof(stage_counters));
+}
+
+#ifdef MLKEM_STAGE_PROFILE
+
+inline uint64_t stage_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* Adds the cycles from construction to the end of the enclosing scope */
+class stage_timer {
+public:
+  explicit stage_timer(stage s) : s_(s), t0_(stage_clock()) {}
+  ~stage_timer() {
+    stage_counters* c = thread_stage_counters();
+    c->cycles[(int)s_] += stage_clock() - t0_;
+    c->calls[(int)s_] += 1;
+  }
+  stage_timer(const stage_timer&) = delete;
+  stage_timer& operator=(const stage_timer&) = delete;
+private:
+  stage s_;
+  uint64_t t0_;
+};
+
+#define MLKEM_STAGE_CAT_(a, b) a##b
+#define MLKEM_STAGE_VAR_(l) MLKEM_STAGE_CAT_(mlkem_stage_timer_, l)
+#define MLKEM_STAGE(s) ::mlkem::stage_timer MLKEM_STAGE_VAR_(__LINE__)(::mlkem::stage::s)
+#define MLKEM_COUNT_REDUCE(n) (::mlkem::thread_stage_counters()->reductions += (n))
+
+#else
+
+#define MLKEM_STAGE(s) ((void)0)
+#define MLKEM_COUNT_REDUCE(n) ((void)0)
+
+#endif
+
+} /* namespace mlkem */
+
+#endif /* PROF_H */
@@ -16,38 +16,32 @@
 
 #if defined(__linux__) || defined(__APPLE__)
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/random.h>
 #endif
 
 #include <cstdint>
 #include <cstdlib>
+#include <atomic>
 
 #include "poly.h"
 #include "shake.h"
 #include "cbd.h"
+#include "prof.h"
 
 namespace mlkem
 {
 
-/* Generate random bytes from os entropy src
+/* Generate random bytes from os entropy src, one system call per call
  * */
-inline void gen_rand_bytes(uint8_t* out, size_t outlen) {
+inline void gen_rand_bytes_os(uint8_t* out, size_t outlen) {
 #ifdef _WIN32
   // todo
-#elif defined(__linux__) || defined(__APPLE__)
-  static int fd = -1;
+#elif defined(__linux__)
   ssize_t ret;
 
-  while(fd == -1) {
-    fd = open("/dev/urandom", O_RDONLY);
-    if(fd == -1 && errno == EINTR)
-      continue;
-    else if(fd == -1)
-      abort();
-  }
-
   while(outlen > 0) {
-    ret = read(fd, out, outlen);
+    ret = getrandom(out, outlen, 0);
     if(ret == -1 && errno == EINTR)
       continue;
     else if(ret == -1)
@@ -56,12 +50,106 @@ inline void gen_rand_bytes(uint8_t* out, size_t outlen) {
     out += ret;
     outlen -= ret;
   }
+#elif defined(__APPLE__)
+  size_t len;
+
+  while(outlen > 0) {
+    len = outlen < 256 ? outlen : 256; /* getentropy limit */
+    if(getentropy(out, len) == -1)
+      abort();
+
+    out += len;
+    outlen -= len;
+  }
 #endif
 }
 
+/* Per thread deterministic random bit generator on shake256
+ *
+ *   every refill expands the key into a new key and a buffer of output, the 
+ *   old key is overwritten and handed out bytes are wiped, so a later state 
+ *   does not reveal earlier output, the key is mixed with fresh os entropy 
+ *   every drbg_reseed_len bytes and in the child after a fork */
+constexpr size_t drbg_buf_len = 4 * sha::shake256_rate - seed_len;
+
+constexpr uint64_t drbg_reseed_len = 1 << 20;
+
+typedef struct {
+  uint8_t key[seed_len];
+  uint8_t buf[drbg_buf_len];
+  size_t pos;            /* bytes of buf already handed out */
+  uint64_t since_reseed; /* bytes handed out since the last reseed */
+  uint64_t fork_gen;     /* fork generation the state was seeded in */
+  int seeded;
+} drbg_ctx;
+
+/* Bumped in the child of every fork, a state seeded in an older generation 
+ *   is a copy of the parent's and must be reseeded
+ * */
+inline std::atomic<uint64_t> drbg_fork_gen{0};
+
+inline uint64_t drbg_fork_generation() {
+#if defined(__linux__) || defined(__APPLE__)
+  static const int registered = pthread_atfork(nullptr, nullptr, [] { drbg_fork_gen.fetch_add(1); });
+  (void)registered;
+#endif
+  return drbg_fork_gen.load(std::memory_order_relaxed);
+}
+
+inline void drbg_reseed(drbg_ctx* ctx) {
+  uint8_t in[2 * seed_len];
+  memcpy(in, ctx->key, seed_len);
+  gen_rand_bytes_os(in + seed_len, seed_len);
+  sha::shake256(ctx->key, seed_len, in, sizeof(in));
+  memset(in, 0, sizeof(in));
+  memset(ctx->buf, 0, drbg_buf_len);
+  ctx->pos = drbg_buf_len;
+  ctx->since_reseed = 0;
+  ctx->fork_gen = drbg_fork_generation();
+  ctx->seeded = 1;
+}
+
+inline void drbg_refill(drbg_ctx* ctx) {
+  uint8_t out[seed_len + drbg_buf_len];
+  sha::shake256(out, sizeof(out), ctx->key, seed_len);
+  memcpy(ctx->key, out, seed_len);
+  memcpy(ctx->buf, out + seed_len, drbg_buf_len);
+  memset(out, 0, sizeof(out));
+  ctx->pos = 0;
+}
+
+inline void drbg_gen(drbg_ctx* ctx, uint8_t* out, size_t outlen) {
+  if (!ctx->seeded || ctx->fork_gen != drbg_fork_generation() || ctx->since_reseed >= drbg_reseed_len) {
+    drbg_reseed(ctx);
+  }
+  ctx->since_reseed += outlen;
+  while (outlen > 0) {
+    if (ctx->pos == drbg_buf_len) { drbg_refill(ctx); }
+    size_t len = drbg_buf_len - ctx->pos;
+    len = outlen < len ? outlen : len;
+    memcpy(out, ctx->buf + ctx->pos, len);
+    memset(ctx->buf + ctx->pos, 0, len);
+    ctx->pos += len;
+    out += len;
+    outlen -= len;
+  }
+}
+
+inline drbg_ctx* thread_drbg() {
+  static thread_local drbg_ctx ctx = {};
+  return &ctx;
+}
+
+/* Generate random bytes from the calling thread's drbg
+ * */
+inline void gen_rand_bytes(uint8_t* out, size_t outlen) {
+  MLKEM_STAGE(rand);
+  drbg_gen(thread_drbg(), out, outlen);
+}
+
 static constexpr size_t mat_nblocks = ( 12 * mlkem_n / 8 * (1 << 12) / mlkem_q + sha::shake128_rate ) / sha::shake128_rate;
 
-static inline unsigned int rej_sample_uniform(int16_t* ptr, unsigned int len, const uint8_t* buf, unsigned int buflen) {
+static inline unsigned int rej_sample_uniform_scalar(int16_t* ptr, unsigned int len, const uint8_t* buf, unsigned int buflen) {
   unsigned int cnt = 0, pos = 0;
   uint16_t v0, v1;
   while (cnt < len && pos + 3 <= buflen) {
@@ -74,41 +162,208 @@ static inline unsigned int rej_sample_uniform(int16_t* ptr, unsigned int len, co
   return cnt;
 }
 
-inline void gen_matrix(poly_vec* a, const uint8_t seed[seed_len], int transposed) {
-  unsigned int cnt, buflen;
-  uint8_t buf[mat_nblocks * sha::shake128_rate];
-  sha::keccak_ctx ctx;
-  for (int i = 0; i < mlkem_k; ++i) {
-    for (int j = 0; j < mlkem_k; ++j) {
-      if (transposed) {
-        shake128_absorb(&ctx, seed, i, j);
-      } else {
-        shake128_absorb(&ctx, seed, j, i);
+#if MLKEM_HAS_AVX2
+
+/* Compaction table for 8 candidates, entry m moves the int16 lanes set in m to
+ *   the front in order, cnt is the number of them */
+typedef struct {
+  alignas(16) int8_t idx[256][16];
+  uint8_t cnt[256];
+} rej_avx2_table_t;
+
+constexpr rej_avx2_table_t make_rej_avx2_table() {
+  rej_avx2_table_t t{};
+  for (int m = 0; m < 256; ++m) {
+    int k = 0;
+    for (int i = 0; i < 8; ++i) {
+      if ((m >> i) & 1) {
+        t.idx[m][2 * k] = 2 * i;
+        t.idx[m][2 * k + 1] = 2 * i + 1;
+        ++k;
       }
+    }
+    for (int i = 2 * k; i < 16; ++i) { t.idx[m][i] = -1; }
+    t.cnt[m] = k;
+  }
+  return t;
+}
+
+inline constexpr rej_avx2_table_t rej_avx2_table = make_rej_avx2_table();
+
+/* Avx2 version of rej_sample_uniform, 16 candidates from 24 bytes per step, 
+ *   runs while all 16 could still be taken so the output is the same as the
+ *   scalar sampler, which finishes the tail */
+MLKEM_TARGET_AVX2 static inline unsigned int rej_sample_uniform_avx2(int16_t* ptr, unsigned int len, 
+  const uint8_t* buf, unsigned int buflen) {
+  unsigned int cnt = 0, pos = 0, m0, m1;
+  const __m256i q = _mm256_set1_epi16(mlkem_q);
+  const __m256i mask = _mm256_set1_epi16(0xfff);
+  /* low lane takes bytes 0..11, high lane bytes 12..23 after the permute */
+  const __m256i idx = _mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+    4, 5, 5, 6, 7, 8, 8, 9, 10, 11, 11, 12, 13, 14, 14, 15);
+  __m256i f, g;
+  __m128i lo, hi;
+  while (cnt + 16 <= len && pos + 32 <= buflen) {
+    f = _mm256_loadu_si256((const __m256i*)(buf + pos));
+    f = _mm256_permute4x64_epi64(f, 0x94);
+    f = _mm256_shuffle_epi8(f, idx);
+    f = _mm256_blend_epi16(f, _mm256_srli_epi16(f, 4), 0xaa);
+    f = _mm256_and_si256(f, mask);
+    pos += 24;
+
+    g = _mm256_cmpgt_epi16(q, f);
+    g = _mm256_packs_epi16(g, g);
+    m0 = (unsigned int)_mm256_movemask_epi8(g);
+    m1 = (m0 >> 16) & 0xff;
+    m0 &= 0xff;
+
+    lo = _mm256_castsi256_si128(f);
+    hi = _mm256_extracti128_si256(f, 1);
+    lo = _mm_shuffle_epi8(lo, _mm_load_si128((const __m128i*)rej_avx2_table.idx[m0]));
+    hi = _mm_shuffle_epi8(hi, _mm_load_si128((const __m128i*)rej_avx2_table.idx[m1]));
+    _mm_storeu_si128((__m128i*)(ptr + cnt), lo);
+    cnt += rej_avx2_table.cnt[m0];
+    _mm_storeu_si128((__m128i*)(ptr + cnt), hi);
+    cnt += rej_avx2_table.cnt[m1];
+  }
+  return cnt + rej_sample_uniform_scalar(ptr + cnt, len - cnt, buf + pos, buflen - pos);
+}
+
+#endif /* MLKEM_HAS_AVX2 */
+
+/* Parse uniform coefficients below q from 12 bit candidates in buf, up to len
+ *   of them, return how many were written
+ * */
+static inline unsigned int rej_sample_uniform(int16_t* ptr, unsigned int len, const uint8_t* buf, unsigned int buflen) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { return rej_sample_uniform_avx2(ptr, len, buf, buflen); }
+#endif
+  return rej_sample_uniform_scalar(ptr, len, buf, buflen);
+}
+
+#ifdef MLKEM_STREAM_MATRIX
+constexpr bool stream_matrix = true;
+#else
+constexpr bool stream_matrix = false;
+#endif
+
+/* Blocks squeezed per pass of the matrix xof, all that one entry usually needs,
+ *   or one at a time when the matrix is streamed, a block is a whole number of
+ *   3 byte candidates so both give the same entries */
+constexpr size_t mat_squeeze_blocks = stream_matrix ? 1 : mat_nblocks;
+
+/* Sample n matrix entries, entry e from the xof of (x[e], y[e]), four entries
+ *   share one pass of the 4-way keccak, two or three left over share one with
+ *   idle lanes that redo the first, a last one runs on a single state
+ * */
+inline void gen_matrix_entries(int16_t* const coeffs[], const uint8_t x[], const uint8_t y[], int n, 
+    const uint8_t seed[seed_len]) {
+  unsigned int cnt[4], buflen;
+  uint8_t buf[4][mat_squeeze_blocks * sha::shake128_rate];
+  int16_t idle[mlkem_n];
+  int16_t* c[4];
+  uint8_t xs[4], ys[4];
+  int e = 0, w;
+  sha::keccakx4_ctx ctx4;
+  sha::keccak_ctx ctx;
+
+  for (; n - e >= 2; e += w) {
+    w = (n - e < 4) ? n - e : 4;
+    for (int l = 0; l < 4; ++l) {
+      c[l] = (l < w) ? coeffs[e + l] : idle;
+      xs[l] = x[e + (l < w ? l : 0)];
+      ys[l] = y[e + (l < w ? l : 0)];
+    }
+    shake128x4_absorb(&ctx4, seed, xs, ys);
 
-      sha::shake128_squeeze_blocks(buf, mat_nblocks, &ctx);
-      buflen = mat_nblocks * sha::shake128_rate;
-      cnt = rej_sample_uniform(a[i].vec[j].coeffs, mlkem_n, buf, buflen);
+    sha::shake128x4_squeeze_blocks(buf[0], buf[1], buf[2], buf[3], mat_squeeze_blocks, &ctx4);
+    buflen = mat_squeeze_blocks * sha::shake128_rate;
+    for (int l = 0; l < 4; ++l) { cnt[l] = rej_sample_uniform(c[l], mlkem_n, buf[l], buflen); }
 
-      while (cnt < mlkem_n) {
-        sha::shake128_squeeze_blocks(buf, 1, &ctx);
-        buflen = sha::shake128_rate;
-        cnt += rej_sample_uniform(a[i].vec[j].coeffs + cnt, mlkem_n - cnt, buf, buflen);
+    while (cnt[0] < mlkem_n || cnt[1] < mlkem_n || cnt[2] < mlkem_n || cnt[3] < mlkem_n) {
+      sha::shake128x4_squeeze_blocks(buf[0], buf[1], buf[2], buf[3], 1, &ctx4);
+      buflen = sha::shake128_rate;
+      for (int l = 0; l < 4; ++l) {
+        cnt[l] += rej_sample_uniform(c[l] + cnt[l], mlkem_n - cnt[l], buf[l], buflen);
       }
     }
   }
+
+  for (; e < n; ++e) {
+    shake128_absorb(&ctx, seed, x[e], y[e]);
+
+    sha::shake128_squeeze_blocks(buf[0], mat_squeeze_blocks, &ctx);
+    buflen = mat_squeeze_blocks * sha::shake128_rate;
+    cnt[0] = rej_sample_uniform(coeffs[e], mlkem_n, buf[0], buflen);
+
+    while (cnt[0] < mlkem_n) {
+      sha::shake128_squeeze_blocks(buf[0], 1, &ctx);
+      buflen = sha::shake128_rate;
+      cnt[0] += rej_sample_uniform(coeffs[e] + cnt[0], mlkem_n - cnt[0], buf[0], buflen);
+    }
+  }
 }
 
+/* Generate matrix A (or A^T when transposed) from the public seed
+ * */
+template <typename P>
+inline void gen_matrix(poly_vec<P>* a, const uint8_t seed[seed_len], int transposed) {
+  MLKEM_STAGE(gen_matrix);
+  constexpr int n = P::mlkem_k * P::mlkem_k;
+  int16_t* coeffs[n];
+  uint8_t x[n], y[n];
+  for (int e = 0; e < n; ++e) {
+    int i = e / P::mlkem_k, j = e % P::mlkem_k;
+    coeffs[e] = a[i].vec[j].coeffs;
+    x[e] = transposed ? i : j;
+    y[e] = transposed ? j : i;
+  }
+  gen_matrix_entries(coeffs, x, y, n, seed);
+}
+
+/* Generate only row i of A (or A^T), the same polys as a[i] of gen_matrix, 
+ *   for products that consume the matrix a row at a time
+ * */
+template <typename P>
+inline void gen_matrix_row(poly_vec<P>* row, const uint8_t seed[seed_len], int i, int transposed) {
+  MLKEM_STAGE(gen_matrix);
+  int16_t* coeffs[P::mlkem_k];
+  uint8_t x[P::mlkem_k], y[P::mlkem_k];
+  for (int j = 0; j < P::mlkem_k; ++j) {
+    coeffs[j] = row->vec[j].coeffs;
+    x[j] = transposed ? i : j;
+    y[j] = transposed ? j : i;
+  }
+  gen_matrix_entries(coeffs, x, y, P::mlkem_k, seed);
+}
+
+template <typename P>
 inline void gen_noise_poly_eta1(poly* p, const uint8_t seed[seed_len], uint8_t nonce) {
-  uint8_t buf[mlkem_eta1 * mlkem_n / 4];
+  MLKEM_STAGE(gen_noise);
+  uint8_t buf[P::mlkem_eta1 * mlkem_n / 4];
   shake256_prf(buf, sizeof(buf), seed, nonce);
-  cbd_eta1(p, buf);
+  cbd_eta<P::mlkem_eta1>(p, buf);
 }
 
+template <typename P>
 inline void gen_noise_poly_eta2(poly* p, const uint8_t seed[seed_len], uint8_t nonce) {
-  uint8_t buf[mlkem_eta2 * mlkem_n / 4];
+  MLKEM_STAGE(gen_noise);
+  uint8_t buf[P::mlkem_eta2 * mlkem_n / 4];
   shake256_prf(buf, sizeof(buf), seed, nonce);
-  cbd_eta2(p, buf);
+  cbd_eta<P::mlkem_eta2>(p, buf);
+}
+
+/* Four noise polys from four (seed, nonce) pairs in one pass of the 4-way 
+ *   keccak, each lane gives the same poly as the single state samplers
+ * */
+template <int eta>
+inline void gen_noise_poly_x4(poly* const p[4], const uint8_t* const seed[4], const uint8_t nonce[4]) {
+  MLKEM_STAGE(gen_noise);
+  constexpr int nblocks = (eta * mlkem_n / 4 + sha::shake256_rate - 1) / sha::shake256_rate;
+  uint8_t buf[4][nblocks * sha::shake256_rate];
+  uint8_t* out[4] = { buf[0], buf[1], buf[2], buf[3] };
+  shake256x4_prf(out, nblocks, seed, nonce);
+  for (int l = 0; l < 4; ++l) { cbd_eta<eta>(p[l], buf[l]); }
 }
 
 } /* namespace mlkem */
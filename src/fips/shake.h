@@ -6,6 +6,7 @@
 #include <cstring>
 
 #include "common.h"
+#include "cpu.h"
 
 namespace sha
 {
@@ -15,13 +16,49 @@ typedef struct {
   unsigned int pos;
 } keccak_ctx;
 
+/* Keccak lanes are little endian, on a little endian host a lane is a plain
+ *   8 byte copy and the state bytes are the rate bytes in order */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define KECCAK_LITTLE_ENDIAN 1
+#else
+#define KECCAK_LITTLE_ENDIAN 0
+#endif
+
 static inline uint64_t load64(const uint8_t x[8]) {
   uint64_t n = 0;
+#if KECCAK_LITTLE_ENDIAN
+  memcpy(&n, x, 8);
+#else
   for (int i = 0; i < 8; ++i) { n |= ((uint64_t)(x[i]) << 8 * i); }
+#endif
   return n;
 }
 
-static inline void save64(uint8_t x[8], uint64_t u) { for (int i = 0; i < 8; ++i) { x[i] = u >> 8 * i; } }
+static inline void save64(uint8_t x[8], uint64_t u) {
+#if KECCAK_LITTLE_ENDIAN
+  memcpy(x, &u, 8);
+#else
+  for (int i = 0; i < 8; ++i) { x[i] = u >> 8 * i; }
+#endif
+}
+
+/* Xor len bytes of in into the state from byte pos on, whole lanes at a time
+ *   once pos is lane aligned */
+static inline void keccak_xor_bytes(uint64_t s[25], unsigned int pos, const uint8_t* in, size_t len) {
+  for (; len && pos % 8; --len, ++pos) { s[pos/8] ^= (uint64_t)*in++ << 8 * (pos % 8); }
+  for (; len >= 8; len -= 8, pos += 8, in += 8) { s[pos/8] ^= load64(in); }
+  for (; len; --len, ++pos) { s[pos/8] ^= (uint64_t)*in++ << 8 * (pos % 8); }
+}
+
+/* Copy len bytes of the state from byte pos on to out
+ * */
+static inline void keccak_extract_bytes(uint8_t* out, const uint64_t s[25], unsigned int pos, size_t len) {
+#if KECCAK_LITTLE_ENDIAN
+  memcpy(out, (const uint8_t*)s + pos, len);
+#else
+  for (size_t i = 0; i < len; ++i, ++pos) { out[i] = s[pos/8] >> 8 * (pos % 8); }
+#endif
+}
 
 #define NROUNDS 24
 
@@ -54,22 +91,25 @@ static const uint64_t keccak_rc[NROUNDS] = {
 
 #define ROL(a, offset) ((a << offset) ^ (a >> (64-offset)))
 
-static inline void keccakf1600_state_permute(uint64_t state[25])
+/* The permutation body, W is either a single 64-bit lane or a vector of 
+ *   lanes from independent states, all ops used are lane-wise */
+template <typename W>
+MLKEM_ALWAYS_INLINE static inline void keccakf1600_permute(W state[25])
 {
   int round;
 
-  uint64_t Aba, Abe, Abi, Abo, Abu;
-  uint64_t Aga, Age, Agi, Ago, Agu;
-  uint64_t Aka, Ake, Aki, Ako, Aku;
-  uint64_t Ama, Ame, Ami, Amo, Amu;
-  uint64_t Asa, Ase, Asi, Aso, Asu;
-  uint64_t BCa, BCe, BCi, BCo, BCu;
-  uint64_t Da, De, Di, Do, Du;
-  uint64_t Eba, Ebe, Ebi, Ebo, Ebu;
-  uint64_t Ega, Ege, Egi, Ego, Egu;
-  uint64_t Eka, Eke, Eki, Eko, Eku;
-  uint64_t Ema, Eme, Emi, Emo, Emu;
-  uint64_t Esa, Ese, Esi, Eso, Esu;
+  W Aba, Abe, Abi, Abo, Abu;
+  W Aga, Age, Agi, Ago, Agu;
+  W Aka, Ake, Aki, Ako, Aku;
+  W Ama, Ame, Ami, Amo, Amu;
+  W Asa, Ase, Asi, Aso, Asu;
+  W BCa, BCe, BCi, BCo, BCu;
+  W Da, De, Di, Do, Du;
+  W Eba, Ebe, Ebi, Ebo, Ebu;
+  W Ega, Ege, Egi, Ego, Egu;
+  W Eka, Eke, Eki, Eko, Eku;
+  W Ema, Eme, Emi, Emo, Emu;
+  W Esa, Ese, Esi, Eso, Esu;
 
   Aba = state[ 0];
   Abe = state[ 1];
@@ -313,19 +353,38 @@ static inline void keccakf1600_state_permute(uint64_t state[25])
   state[24] = Asu;
 }
 
+static inline void keccakf1600_state_permute_scalar(uint64_t state[25]) { keccakf1600_permute(state); }
+
+#if MLKEM_HAS_BMI2
+
+/* The same permutation compiled with bmi, the chi step becomes andn and the
+ *   rotations rorx, which saves the register copies of the plain x86 code */
+MLKEM_TARGET_BMI2 static inline void keccakf1600_state_permute_bmi2(uint64_t state[25]) {
+  keccakf1600_permute(state);
+}
+
+#endif /* MLKEM_HAS_BMI2 */
+
+static inline void keccakf1600_state_permute(uint64_t state[25]) {
+#if MLKEM_HAS_BMI2
+  if (mlkem::cpu_has_bmi2()) { keccakf1600_state_permute_bmi2(state); return; }
+#endif
+  keccakf1600_state_permute_scalar(state);
+}
+
 inline void keccak_init(uint64_t s[25]) { for (int i = 0; i < 25; ++i) { s[i] = 0; } }
 
 static inline unsigned int keccak_absorb(
     uint64_t s[25], unsigned int pos, unsigned int r, const uint8_t* in, size_t inlen) {
-  unsigned int i;
   while (pos + inlen >= r) {
-    for (int i = pos; i < r; ++i) { s[i/8] ^= (uint64_t)*in++ << 8 * (i % 8); }
+    keccak_xor_bytes(s, pos, in, r - pos);
+    in += r - pos;
     inlen -= (r - pos);
     keccakf1600_state_permute(s);
     pos = 0;
   }
-  for (i = pos; i < pos + inlen; ++i) { s[i/8] ^= (uint64_t)(*in++) << 8 * (i % 8); }
-  return i;
+  keccak_xor_bytes(s, pos, in, inlen);
+  return pos + inlen;
 }
 
 static inline void keccak_finalize(uint64_t s[25], unsigned int pos, unsigned int r, uint8_t p) {
@@ -335,29 +394,32 @@ static inline void keccak_finalize(uint64_t s[25], unsigned int pos, unsigned in
 
 static inline unsigned int keccak_squeeze(
     uint8_t* out, size_t outlen, uint64_t s[25], unsigned int pos, unsigned int r) {
-  int i = 0;
+  size_t n;
   while (outlen) {
     if (pos == r) {
       keccakf1600_state_permute(s);
       pos = 0;
     }
-    for (i = pos; i < r && i < outlen + pos; ++i) { *out++ = s[i/8] >> 8 * (i % 8); }
-    outlen -= (i - pos);
-    pos = i;
+    n = (r - pos < outlen) ? r - pos : outlen;
+    keccak_extract_bytes(out, s, pos, n);
+    out += n;
+    outlen -= n;
+    pos += n;
   }
   return pos;
 }
 
 static inline void keccak_absorb_once(uint64_t s[25], unsigned int r, const uint8_t* in, size_t inlen, uint8_t p) {
-  int i;
-  for (int i = 0; i < 25; ++i) { s[i] = 0; }
+  unsigned int i;
+  for (i = 0; i < 25; ++i) { s[i] = 0; }
   while (inlen >= r) {
     for (i = 0; i < r / 8; ++i) { s[i] ^= load64(in + 8 * i); }
     in += r;
     inlen -= r;
     keccakf1600_state_permute(s);
   }
-  for (i = 0; i < inlen; ++i) { s[i/8] ^= (uint64_t)(in[i]) << 8 * (i % 8); }
+  keccak_xor_bytes(s, 0, in, inlen);
+  i = inlen;
   s[i/8] ^= (uint64_t)(p) << 8 * (i % 8);
   s[(r-1)/8] ^= 1ULL << 63;
 }
@@ -476,6 +538,114 @@ inline void sha3_512(uint8_t out[64], const uint8_t* in, size_t inlen) {
   }
 }
 
+/* Four keccak states interleaved by lane, word i of state l is s[4 * i + l],
+ *   so that the avx2 permutation moves one word of all four states at once */
+typedef struct {
+  alignas(32) uint64_t s[100];
+} keccakx4_ctx;
+
+static inline void keccakx4_permute_scalar(uint64_t s[100]) {
+  uint64_t t[25];
+  for (int l = 0; l < 4; ++l) {
+    for (int i = 0; i < 25; ++i) { t[i] = s[4 * i + l]; }
+    keccakf1600_state_permute(t);
+    for (int i = 0; i < 25; ++i) { s[4 * i + l] = t[i]; }
+  }
+}
+
+#if MLKEM_HAS_AVX2
+
+typedef uint64_t keccakx4_lane __attribute__((vector_size(32)));
+
+MLKEM_TARGET_AVX2 static inline void keccakx4_permute_avx2(uint64_t s[100]) {
+  keccakx4_lane t[25];
+  memcpy(t, s, sizeof(t));
+  keccakf1600_permute(t);
+  memcpy(s, t, sizeof(t));
+}
+
+#endif /* MLKEM_HAS_AVX2 */
+
+inline void keccakx4_permute(uint64_t s[100]) {
+#if MLKEM_HAS_AVX2
+  if (mlkem::cpu_has_avx2()) { keccakx4_permute_avx2(s); return; }
+#endif
+  keccakx4_permute_scalar(s);
+}
+
+/* Absorb four inputs of the same length into four fresh states
+ * */
+static inline void keccakx4_absorb_once(uint64_t s[100], unsigned int r, 
+    const uint8_t* const in[4], size_t inlen, uint8_t p) {
+  const uint8_t* x[4] = { in[0], in[1], in[2], in[3] };
+  unsigned int i;
+  for (i = 0; i < 100; ++i) { s[i] = 0; }
+  while (inlen >= r) {
+    for (i = 0; i < r / 8; ++i) {
+      for (int l = 0; l < 4; ++l) { s[4 * i + l] ^= load64(x[l] + 8 * i); }
+    }
+    for (int l = 0; l < 4; ++l) { x[l] += r; }
+    inlen -= r;
+    keccakx4_permute(s);
+  }
+  for (i = 0; i < inlen; ++i) {
+    for (int l = 0; l < 4; ++l) { s[4 * (i / 8) + l] ^= (uint64_t)(x[l][i]) << 8 * (i % 8); }
+  }
+  for (int l = 0; l < 4; ++l) {
+    s[4 * (i / 8) + l] ^= (uint64_t)(p) << 8 * (i % 8);
+    s[4 * ((r - 1) / 8) + l] ^= 1ULL << 63;
+  }
+}
+
+static inline void keccakx4_squeeze_blocks(uint8_t* const out[4], size_t nblocks, 
+    uint64_t s[100], unsigned int r) {
+  uint8_t* x[4] = { out[0], out[1], out[2], out[3] };
+  while (nblocks) {
+    keccakx4_permute(s);
+    for (unsigned int i = 0; i < r / 8; ++i) {
+      for (int l = 0; l < 4; ++l) { save64(x[l] + 8 * i, s[4 * i + l]); }
+    }
+    for (int l = 0; l < 4; ++l) { x[l] += r; }
+    nblocks -= 1;
+  }
+}
+
+inline void shake128x4_absorb_once(keccakx4_ctx* ctx, const uint8_t* in0, const uint8_t* in1, 
+    const uint8_t* in2, const uint8_t* in3, size_t inlen) {
+  const uint8_t* in[4] = { in0, in1, in2, in3 };
+  keccakx4_absorb_once(ctx->s, shake128_rate, in, inlen, 0x1f);
+}
+
+inline void shake128x4_squeeze_blocks(uint8_t* out0, uint8_t* out1, uint8_t* out2, uint8_t* out3, 
+    size_t nblocks, keccakx4_ctx* ctx) {
+  uint8_t* out[4] = { out0, out1, out2, out3 };
+  keccakx4_squeeze_blocks(out, nblocks, ctx->s, shake128_rate);
+}
+
+inline void shake256x4_absorb_once(keccakx4_ctx* ctx, const uint8_t* in0, const uint8_t* in1, 
+    const uint8_t* in2, const uint8_t* in3, size_t inlen) {
+  const uint8_t* in[4] = { in0, in1, in2, in3 };
+  keccakx4_absorb_once(ctx->s, shake256_rate, in, inlen, 0x1f);
+}
+
+inline void shake256x4_squeeze_blocks(uint8_t* out0, uint8_t* out1, uint8_t* out2, uint8_t* out3, 
+    size_t nblocks, keccakx4_ctx* ctx) {
+  uint8_t* out[4] = { out0, out1, out2, out3 };
+  keccakx4_squeeze_blocks(out, nblocks, ctx->s, shake256_rate);
+}
+
+inline void sha3_512x4(uint8_t out0[64], uint8_t out1[64], uint8_t out2[64], uint8_t out3[64], 
+    const uint8_t* in0, const uint8_t* in1, const uint8_t* in2, const uint8_t* in3, size_t inlen) {
+  keccakx4_ctx ctx;
+  const uint8_t* in[4] = { in0, in1, in2, in3 };
+  uint8_t* out[4] = { out0, out1, out2, out3 };
+  keccakx4_absorb_once(ctx.s, sha3_512_rate, in, inlen, 0x06);
+  keccakx4_permute(ctx.s);
+  for (int i = 0; i < 8; ++i) {
+    for (int l = 0; l < 4; ++l) { save64(out[l] + 8 * i, ctx.s[4 * i + l]); }
+  }
+}
+
 } /* namespace sha */
 
 namespace mlkem
@@ -491,6 +661,20 @@ inline void shake128_absorb(sha::keccak_ctx* ctx, const uint8_t seed[seed_len],
   sha::shake128_absorb_once(ctx, extended_seed, sizeof(extended_seed)); 
 }
 
+/* Absorb the extended seeds of four matrix entries at once
+ * */
+inline void shake128x4_absorb(sha::keccakx4_ctx* ctx, const uint8_t seed[seed_len], 
+    const uint8_t x[4], const uint8_t y[4]) {
+  uint8_t extended_seed[4][seed_len + 2];
+  for (int l = 0; l < 4; ++l) {
+    memcpy(extended_seed[l], seed, seed_len);
+    extended_seed[l][seed_len + 0] = x[l];
+    extended_seed[l][seed_len + 1] = y[l];
+  }
+  sha::shake128x4_absorb_once(ctx, extended_seed[0], extended_seed[1], extended_seed[2], 
+    extended_seed[3], seed_len + 2);
+}
+
 /* Generate the noise polynomials and secret vectors
  * */
 inline void shake256_prf(uint8_t* out, size_t len, const uint8_t key[seed_len], uint8_t nonce) {
@@ -500,22 +684,56 @@ inline void shake256_prf(uint8_t* out, size_t len, const uint8_t key[seed_len],
   sha::shake256(out, len, buf, sizeof(buf));
 }
 
+/* Four prf outputs of whole shake256 blocks in one pass of the 4-way keccak
+ * */
+inline void shake256x4_prf(uint8_t* const out[4], size_t nblocks, 
+    const uint8_t* const key[4], const uint8_t nonce[4]) {
+  uint8_t buf[4][seed_len + 1];
+  sha::keccakx4_ctx ctx;
+  for (int l = 0; l < 4; ++l) {
+    memcpy(buf[l], key[l], seed_len);
+    buf[l][seed_len] = nonce[l];
+  }
+  sha::shake256x4_absorb_once(&ctx, buf[0], buf[1], buf[2], buf[3], seed_len + 1);
+  sha::shake256x4_squeeze_blocks(out[0], out[1], out[2], out[3], nblocks, &ctx);
+}
+
 /* Regenerate final shared secret after the ciphertext has been processed
  *   out: shared secret
  *   key: part of mlkem private key
  *   input: actual cipher text received over the network
  */
+template <typename P>
 inline void shake256_rkprf(uint8_t out[32], const uint8_t key[seed_len], 
-  const uint8_t input[compressed_poly_vec_len + compressed_poly_len])
+  const uint8_t input[P::cipher_len])
 {
   sha::keccak_ctx ctx;
   sha::shake256_init(&ctx);
   sha::shake256_absorb(&ctx, key, seed_len);
-  sha::shake256_absorb(&ctx, input, compressed_poly_vec_len + compressed_poly_len);
+  sha::shake256_absorb(&ctx, input, P::cipher_len);
   sha::shake256_finalize(&ctx);
   sha::shake256_squeeze(out, msg_len, &ctx);
 }
 
+/* Rejection prf of four ciphers under the same key in one pass of the 4-way 
+ *   keccak, lane l gives the same output as shake256_rkprf on input[l]
+ * */
+template <typename P>
+inline void shake256_rkprf_x4(uint8_t* const out[4], const uint8_t key[seed_len], 
+  const uint8_t* const input[4])
+{
+  uint8_t buf[4][seed_len + P::cipher_len];
+  uint8_t blk[4][sha::shake256_rate];
+  sha::keccakx4_ctx ctx;
+  for (int l = 0; l < 4; ++l) {
+    memcpy(buf[l], key, seed_len);
+    memcpy(buf[l] + seed_len, input[l], P::cipher_len);
+  }
+  sha::shake256x4_absorb_once(&ctx, buf[0], buf[1], buf[2], buf[3], seed_len + P::cipher_len);
+  sha::shake256x4_squeeze_blocks(blk[0], blk[1], blk[2], blk[3], 1, &ctx);
+  for (int l = 0; l < 4; ++l) { memcpy(out[l], blk[l], msg_len); }
+}
+
 } /* namespace mlkem */
 
 
@@ -0,0 +1,386 @@
+/* Copyright 2026, Yao Zeran, Zhang Chenzhi
+ *
+ * The <soa.h> file defines an interleaved (structure of arrays) layout of a
+ *   group of polynomials and the ntt domain kernels on it, for a batch path
+ *   over 16 independent operations, decap_batch decrypts its ciphers on it
+ *   16 at a time. */
+
+#ifndef SOA_H
+#define SOA_H
+
+#include <cstdint>
+
+#include "common.h"
+#include "cpu.h"
+#include "opt.h"
+#include "poly.h"
+
+namespace mlkem
+{
+
+/* L polys stored coefficient major, c[i][l] is coefficient i of lane l, so
+ *   with L = 16 a row is one avx2 vector holding the same coefficient of 16
+ *   polys, one per independent operation, a poly vec takes k of these groups
+ *   (group i holds poly i of every lane), which is the layout 
+ *   poly_soa_basemul_acc works on
+ *
+ *   every butterfly of the ntt uses the same zeta across a row, so the kernels
+ *   need no shuffles, each lane sees the same arithmetic as the poly kernels
+ *   and gives the same output bit by bit, with the same bounds */
+template <int L = 16>
+struct poly_soa {
+  static_assert(L > 0 && L % 16 == 0, "a row must be whole avx2 vectors");
+  static constexpr int lanes = L;
+  alignas(64) int16_t c[mlkem_n][L];
+};
+
+/* Conversions from and to the poly layout, one lane at a time
+ * */
+template <int L>
+inline void poly_soa_load(poly_soa<L>* s, int lane, const poly* p) {
+  for (int i = 0; i < mlkem_n; ++i) { s->c[i][lane] = p->coeffs[i]; }
+}
+
+template <int L>
+inline void poly_soa_store(poly* p, const poly_soa<L>* s, int lane) {
+  for (int i = 0; i < mlkem_n; ++i) { p->coeffs[i] = s->c[i][lane]; }
+}
+
+/* Poly i of pv goes to the given lane of group s[i] */
+template <typename P, int L>
+inline void poly_vec_to_soa(poly_soa<L> s[P::mlkem_k], int lane, const poly_vec<P>* pv) {
+  for (int i = 0; i < P::mlkem_k; ++i) { poly_soa_load(&s[i], lane, &pv->vec[i]); }
+}
+
+template <typename P, int L>
+inline void soa_to_poly_vec(poly_vec<P>* pv, const poly_soa<L> s[P::mlkem_k], int lane) {
+  for (int i = 0; i < P::mlkem_k; ++i) { poly_soa_store(&pv->vec[i], &s[i], lane); }
+}
+
+template <int L>
+inline void bytes_to_poly_soa(poly_soa<L>* s, int lane, const uint8_t in[poly_len]) {
+  poly t;
+  bytes_to_poly(&t, in);
+  poly_soa_load(s, lane, &t);
+}
+
+template <int L>
+inline void poly_soa_to_bytes(uint8_t out[poly_len], const poly_soa<L>* s, int lane) {
+  poly t;
+  poly_soa_store(&t, s, lane);
+  poly_to_bytes(out, &t);
+}
+
+template <int d, int L>
+inline void poly_soa_decompress(poly_soa<L>* s, int lane, const uint8_t in[d * mlkem_n / 8]) {
+  poly t;
+  poly_decompress<d>(&t, in);
+  poly_soa_load(s, lane, &t);
+}
+
+template <int d, int L>
+inline void poly_soa_compress(uint8_t out[d * mlkem_n / 8], const poly_soa<L>* s, int lane) {
+  poly t;
+  poly_soa_store(&t, s, lane);
+  poly_compress<d>(out, &t);
+}
+
+/* Scalar kernels, the lane loops are innermost so they still vectorize
+ * */
+template <int L>
+inline void poly_soa_reduce_scalar(poly_soa<L>* s) {
+  for (int i = 0; i < mlkem_n; ++i) {
+    for (int l = 0; l < L; ++l) { s->c[i][l] = barrett_reduce(s->c[i][l]); }
+  }
+}
+
+template <int L>
+inline void poly_soa_ntt_scalar(poly_soa<L>* s) {
+  unsigned int len, start, j, k = 1;
+  for (len = 128; len >= 2; len >>= 1) {
+    for (start = 0; start < 256; start += 2 * len, ++k) {
+      for (j = start; j < start + len; ++j) {
+        for (int l = 0; l < L; ++l) { butterfly(s->c[j][l], s->c[j + len][l], k); }
+      }
+    }
+  }
+}
+
+template <int L>
+inline void poly_soa_invntt_scalar(poly_soa<L>* s) {
+  unsigned int len, start, j, k = 127;
+  for (len = 2; len <= 64; len <<= 1) {
+    for (start = 0; start < 256; start += 2 * len, --k) {
+      for (j = start; j < start + len; ++j) {
+        for (int l = 0; l < L; ++l) {
+          if (len == invntt_reduce_len) {
+            invbutterfly<true>(s->c[j][l], s->c[j + len][l], k);
+          } else {
+            invbutterfly<false>(s->c[j][l], s->c[j + len][l], k);
+          }
+        }
+      }
+    }
+  }
+  for (j = 0; j < 128; ++j) {
+    for (int l = 0; l < L; ++l) { invbutterfly_last(s->c[j][l], s->c[j + 128][l]); }
+  }
+}
+
+/* Lane wise inner product of K groups, lane l of p gets poly_vec_basemul of
+ *   the polys in lane l of a[0..K) and b[0..K) */
+template <int K, int L>
+inline void poly_soa_basemul_acc_scalar(poly_soa<L>* p, const poly_soa<L> a[K], const poly_soa<L> b[K]) {
+  int32_t r0, r1, r2, r3;
+  for (int j = 0; j < mlkem_n / 4; ++j) {
+    const int16_t g0 = ntt_plan.gammas[2 * j], g1 = ntt_plan.gammas[2 * j + 1];
+    for (int l = 0; l < L; ++l) {
+      r0 = r1 = r2 = r3 = 0;
+      for (int i = 0; i < K; ++i) {
+        const int16_t x0 = a[i].c[4 * j][l], x1 = a[i].c[4 * j + 1][l];
+        const int16_t x2 = a[i].c[4 * j + 2][l], x3 = a[i].c[4 * j + 3][l];
+        const int16_t y0 = b[i].c[4 * j][l], y1 = b[i].c[4 * j + 1][l];
+        const int16_t y2 = b[i].c[4 * j + 2][l], y3 = b[i].c[4 * j + 3][l];
+        r0 += (int32_t)x0 * y0 + (int32_t)fqmul(x1, y1) * g0;
+        r1 += (int32_t)x0 * y1 + (int32_t)x1 * y0;
+        r2 += (int32_t)x2 * y2 + (int32_t)fqmul(x3, y3) * g1;
+        r3 += (int32_t)x2 * y3 + (int32_t)x3 * y2;
+      }
+      p->c[4 * j][l] = barrett_reduce(montgomery_reduce(r0));
+      p->c[4 * j + 1][l] = barrett_reduce(montgomery_reduce(r1));
+      p->c[4 * j + 2][l] = barrett_reduce(montgomery_reduce(r2));
+      p->c[4 * j + 3][l] = barrett_reduce(montgomery_reduce(r3));
+    }
+  }
+}
+
+/* As poly_soa_basemul_acc with one vector b shared by every lane, given by
+ *   its polys and their multiplication caches, as the secret key of a batch
+ *   of decaps, the sums are those of the cached poly_vec_basemul, p may be 
+ *   a[0] as each row of p is written after its rows of a are read */
+template <int K, int L>
+inline void poly_soa_basemul_acc_shared_scalar(poly_soa<L>* p, const poly_soa<L> a[K], 
+  const poly b[K], const poly_mulcache bc[K]) {
+  int32_t r0, r1, r2, r3;
+  for (int j = 0; j < mlkem_n / 4; ++j) {
+    for (int l = 0; l < L; ++l) {
+      r0 = r1 = r2 = r3 = 0;
+      for (int i = 0; i < K; ++i) {
+        const int16_t x0 = a[i].c[4 * j][l], x1 = a[i].c[4 * j + 1][l];
+        const int16_t x2 = a[i].c[4 * j + 2][l], x3 = a[i].c[4 * j + 3][l];
+        const int16_t* y = &b[i].coeffs[4 * j];
+        const int16_t* c = &bc[i].coeffs[2 * j];
+        r0 += (int32_t)x0 * y[0] + (int32_t)x1 * c[0];
+        r1 += (int32_t)x0 * y[1] + (int32_t)x1 * y[0];
+        r2 += (int32_t)x2 * y[2] + (int32_t)x3 * c[1];
+        r3 += (int32_t)x2 * y[3] + (int32_t)x3 * y[2];
+      }
+      p->c[4 * j][l] = barrett_reduce(montgomery_reduce(r0));
+      p->c[4 * j + 1][l] = barrett_reduce(montgomery_reduce(r1));
+      p->c[4 * j + 2][l] = barrett_reduce(montgomery_reduce(r2));
+      p->c[4 * j + 3][l] = barrett_reduce(montgomery_reduce(r3));
+    }
+  }
+}
+
+#if MLKEM_HAS_AVX2
+
+/* Avx2 kernels, each row is L / 16 vectors and every op is the row op of
+ *   the avx2 poly kernels with a broadcast zeta */
+template <int L>
+MLKEM_TARGET_AVX2 inline void poly_soa_reduce_avx2(poly_soa<L>* s) {
+  __m256i* v = (__m256i*)s->c;
+  for (int i = 0; i < mlkem_n * L / 16; ++i) { v[i] = barrett_reduce_avx2(v[i]); }
+}
+
+template <int L>
+MLKEM_TARGET_AVX2 inline void poly_soa_ntt_avx2(poly_soa<L>* s) {
+  constexpr int w = L / 16;
+  unsigned int len, start, j, k = 1;
+  __m256i* v = (__m256i*)s->c;
+  __m256i zeta, zeta_qinv;
+  for (len = 128; len >= 2; len >>= 1) {
+    for (start = 0; start < 256; start += 2 * len) {
+      twiddle_avx2(zeta, zeta_qinv, k++);
+      for (j = start * w; j < (start + len) * w; ++j) { butterfly_avx2(v[j], v[j + len * w], zeta, zeta_qinv); }
+    }
+  }
+}
+
+template <int L>
+MLKEM_TARGET_AVX2 inline void poly_soa_invntt_avx2(poly_soa<L>* s) {
+  constexpr int w = L / 16;
+  unsigned int len, start, j, k = 127;
+  __m256i* v = (__m256i*)s->c;
+  __m256i zeta, zeta_qinv;
+  for (len = 2; len <= 64; len <<= 1) {
+    for (start = 0; start < 256; start += 2 * len) {
+      twiddle_avx2(zeta, zeta_qinv, k--);
+      for (j = start * w; j < (start + len) * w; ++j) {
+        if (len == invntt_reduce_len) {
+          invbutterfly_avx2<true>(v[j], v[j + len * w], zeta, zeta_qinv);
+        } else {
+          invbutterfly_avx2<false>(v[j], v[j + len * w], zeta, zeta_qinv);
+        }
+      }
+    }
+  }
+  for (j = 0; j < 128 * w; ++j) { invbutterfly_last_avx2(v[j], v[j + 128 * w]); }
+}
+
+/* montgomery_reduce on 32 bit lanes, the result fits 16 bits
+ * */
+MLKEM_TARGET_AVX2 static inline __m256i montgomery_reduce_epi32_avx2(__m256i a) {
+  __m256i t = _mm256_mullo_epi32(a, _mm256_set1_epi32(mlkem_inverse_q));
+  t = _mm256_srai_epi32(_mm256_slli_epi32(t, 16), 16);
+  t = _mm256_mullo_epi32(t, _mm256_set1_epi32(mlkem_q));
+  return _mm256_srai_epi32(_mm256_sub_epi32(a, t), 16);
+}
+
+/* The int32 sums of poly_soa_basemul_acc_scalar, madd_epi16 takes the two
+ *   products of a sum at once from pairs interleaved by unpack, packs_epi32
+ *   undoes the interleave */
+template <int K, int L>
+MLKEM_TARGET_AVX2 inline void poly_soa_basemul_acc_avx2(poly_soa<L>* p, const poly_soa<L> a[K], const poly_soa<L> b[K]) {
+  constexpr int w = L / 16;
+  __m256i x0, x1, x2, x3, y0, y1, y2, y3, t1, t3, zeta, nzeta;
+  __m256i r[4][2];
+  __m256i* out = (__m256i*)p->c;
+  for (int j = 0; j < mlkem_n / 4; ++j) {
+    zeta = _mm256_set1_epi16(ntt_plan.gammas[2 * j]);
+    nzeta = _mm256_set1_epi16(ntt_plan.gammas[2 * j + 1]);
+    for (int u = 0; u < w; ++u) {
+      for (int m = 0; m < 4; ++m) { r[m][0] = r[m][1] = _mm256_setzero_si256(); }
+      for (int i = 0; i < K; ++i) {
+        const __m256i* x = (const __m256i*)a[i].c[4 * j] + u;
+        const __m256i* y = (const __m256i*)b[i].c[4 * j] + u;
+        x0 = x[0]; x1 = x[w]; x2 = x[2 * w]; x3 = x[3 * w];
+        y0 = y[0]; y1 = y[w]; y2 = y[2 * w]; y3 = y[3 * w];
+        t1 = fqmul_avx2(x1, y1);
+        t3 = fqmul_avx2(x3, y3);
+        r[0][0] = _mm256_add_epi32(r[0][0], _mm256_madd_epi16(_mm256_unpacklo_epi16(x0, t1), _mm256_unpacklo_epi16(y0, zeta)));
+        r[0][1] = _mm256_add_epi32(r[0][1], _mm256_madd_epi16(_mm256_unpackhi_epi16(x0, t1), _mm256_unpackhi_epi16(y0, zeta)));
+        r[1][0] = _mm256_add_epi32(r[1][0], _mm256_madd_epi16(_mm256_unpacklo_epi16(x0, x1), _mm256_unpacklo_epi16(y1, y0)));
+        r[1][1] = _mm256_add_epi32(r[1][1], _mm256_madd_epi16(_mm256_unpackhi_epi16(x0, x1), _mm256_unpackhi_epi16(y1, y0)));
+        r[2][0] = _mm256_add_epi32(r[2][0], _mm256_madd_epi16(_mm256_unpacklo_epi16(x2, t3), _mm256_unpacklo_epi16(y2, nzeta)));
+        r[2][1] = _mm256_add_epi32(r[2][1], _mm256_madd_epi16(_mm256_unpackhi_epi16(x2, t3), _mm256_unpackhi_epi16(y2, nzeta)));
+        r[3][0] = _mm256_add_epi32(r[3][0], _mm256_madd_epi16(_mm256_unpacklo_epi16(x2, x3), _mm256_unpacklo_epi16(y3, y2)));
+        r[3][1] = _mm256_add_epi32(r[3][1], _mm256_madd_epi16(_mm256_unpackhi_epi16(x2, x3), _mm256_unpackhi_epi16(y3, y2)));
+      }
+      for (int m = 0; m < 4; ++m) {
+        out[(4 * j + m) * w + u] = barrett_reduce_avx2(_mm256_packs_epi32(
+          montgomery_reduce_epi32_avx2(r[m][0]), montgomery_reduce_epi32_avx2(r[m][1])));
+      }
+    }
+  }
+}
+
+/* Two int16 repeated over the int32 lanes, lo in the low half
+ * */
+MLKEM_TARGET_AVX2 static inline __m256i pair_epi16_avx2(int16_t lo, int16_t hi) {
+  return _mm256_set1_epi32((int32_t)((uint32_t)(uint16_t)lo | (uint32_t)(uint16_t)hi << 16));
+}
+
+/* The sums of poly_soa_basemul_acc_shared_scalar, b and its cache are the 
+ *   same in every lane so each sum is one madd_epi16 of an interleaved pair
+ *   of rows of a with a broadcast pair of b */
+template <int K, int L>
+MLKEM_TARGET_AVX2 inline void poly_soa_basemul_acc_shared_avx2(poly_soa<L>* p, const poly_soa<L> a[K], 
+  const poly b[K], const poly_mulcache bc[K]) {
+  constexpr int w = L / 16;
+  __m256i lo01, hi01, lo23, hi23, y0c0, y1y0, y2c1, y3y2;
+  __m256i r[4][2];
+  __m256i* out = (__m256i*)p->c;
+  for (int j = 0; j < mlkem_n / 4; ++j) {
+    for (int u = 0; u < w; ++u) {
+      for (int m = 0; m < 4; ++m) { r[m][0] = r[m][1] = _mm256_setzero_si256(); }
+      for (int i = 0; i < K; ++i) {
+        const __m256i* x = (const __m256i*)a[i].c[4 * j] + u;
+        const int16_t* y = &b[i].coeffs[4 * j];
+        const int16_t* c = &bc[i].coeffs[2 * j];
+        y0c0 = pair_epi16_avx2(y[0], c[0]);
+        y1y0 = pair_epi16_avx2(y[1], y[0]);
+        y2c1 = pair_epi16_avx2(y[2], c[1]);
+        y3y2 = pair_epi16_avx2(y[3], y[2]);
+        lo01 = _mm256_unpacklo_epi16(x[0], x[w]);
+        hi01 = _mm256_unpackhi_epi16(x[0], x[w]);
+        lo23 = _mm256_unpacklo_epi16(x[2 * w], x[3 * w]);
+        hi23 = _mm256_unpackhi_epi16(x[2 * w], x[3 * w]);
+        r[0][0] = _mm256_add_epi32(r[0][0], _mm256_madd_epi16(lo01, y0c0));
+        r[0][1] = _mm256_add_epi32(r[0][1], _mm256_madd_epi16(hi01, y0c0));
+        r[1][0] = _mm256_add_epi32(r[1][0], _mm256_madd_epi16(lo01, y1y0));
+        r[1][1] = _mm256_add_epi32(r[1][1], _mm256_madd_epi16(hi01, y1y0));
+        r[2][0] = _mm256_add_epi32(r[2][0], _mm256_madd_epi16(lo23, y2c1));
+        r[2][1] = _mm256_add_epi32(r[2][1], _mm256_madd_epi16(hi23, y2c1));
+        r[3][0] = _mm256_add_epi32(r[3][0], _mm256_madd_epi16(lo23, y3y2));
+        r[3][1] = _mm256_add_epi32(r[3][1], _mm256_madd_epi16(hi23, y3y2));
+      }
+      for (int m = 0; m < 4; ++m) {
+        out[(4 * j + m) * w + u] = barrett_reduce_avx2(_mm256_packs_epi32(
+          montgomery_reduce_epi32_avx2(r[m][0]), montgomery_reduce_epi32_avx2(r[m][1])));
+      }
+    }
+  }
+}
+
+#endif /* MLKEM_HAS_AVX2 */
+
+/* Dispatchers, the avx2 kernels give the same output as the scalar ones
+ * */
+template <int L>
+inline void poly_soa_reduce(poly_soa<L>* s) {
+  MLKEM_COUNT_REDUCE(mlkem_n * L);
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { poly_soa_reduce_avx2(s); return; }
+#endif
+  poly_soa_reduce_scalar(s);
+}
+
+/* Forward ntt of every lane, not reduced, see poly_ntt */
+template <int L>
+inline void poly_soa_ntt(poly_soa<L>* s) {
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { poly_soa_ntt_avx2(s); return; }
+#endif
+  poly_soa_ntt_scalar(s);
+}
+
+/* Inverse ntt of every lane, lazily reduced, see poly_invntt */
+template <int L>
+inline void poly_soa_invntt(poly_soa<L>* s) {
+  MLKEM_COUNT_REDUCE(128 * L);
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { poly_soa_invntt_avx2(s); return; }
+#endif
+  poly_soa_invntt_scalar(s);
+}
+
+template <int K, int L>
+inline void poly_soa_basemul_acc(poly_soa<L>* p, const poly_soa<L> a[K], const poly_soa<L> b[K]) {
+  MLKEM_COUNT_REDUCE(mlkem_n * L);
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { poly_soa_basemul_acc_avx2<K>(p, a, b); return; }
+#endif
+  poly_soa_basemul_acc_scalar<K>(p, a, b);
+}
+
+template <int K, int L>
+inline void poly_soa_basemul_acc_shared(poly_soa<L>* p, const poly_soa<L> a[K], 
+  const poly b[K], const poly_mulcache bc[K]) {
+  MLKEM_COUNT_REDUCE(mlkem_n * L);
+#if MLKEM_HAS_AVX2
+  if (cpu_has_avx2()) { poly_soa_basemul_acc_shared_avx2<K>(p, a, b, bc); return; }
+#endif
+  poly_soa_basemul_acc_shared_scalar<K>(p, a, b, bc);
+}
+
+template <int L>
+inline void poly_soa_add(poly_soa<L>* p, const poly_soa<L>* a, const poly_soa<L>* b) {
+  for (int i = 0; i < mlkem_n; ++i) {
+    for (int l = 0; l < L; ++l) { p->c[i][l] = a->c[i][l] + b->c[i][l]; }
+  }
+}
+
+} /* namespace mlkem */
+
+#endif /* SOA_H */
@@ -29,25 +29,26 @@ uint8_t drb[mlkem::seed_len]{
 int main(int argc, char* argv[]) {
 
   /* test mlkem: key gen, encap, decap */
-  uint8_t public_key[mlkem::poly_vec_len + mlkem::seed_len];
-  uint8_t private_key[2 * mlkem::poly_vec_len + 2 * mlkem::seed_len + sha::hash256_len];
+  using P = mlkem::mlkem512;
+  uint8_t public_key[P::ek_len];
+  uint8_t private_key[P::dk_len];
 
   std::cout << std::endl;
   std::cout << std::endl;
-  mlkem::key_gen(public_key, private_key);
+  mlkem::key_gen<P>(public_key, private_key);
   std::cout << "Public key generated: " << std::endl;
-  print_bytes(public_key, mlkem::poly_vec_len + mlkem::seed_len);
+  print_bytes(public_key, P::ek_len);
   std::cout << std::endl;
   std::cout << "Private key generated: "<< std::endl;
-  print_bytes(private_key, mlkem::poly_vec_len);
+  print_bytes(private_key, P::poly_vec_len);
   std::cout << std::endl;
 
   uint8_t alice_secret_key[32];
-  uint8_t cipher[mlkem::compressed_poly_len + mlkem::compressed_poly_vec_len];
-  mlkem::encap(cipher, alice_secret_key, public_key);
+  uint8_t cipher[P::cipher_len];
+  mlkem::encap<P>(cipher, alice_secret_key, public_key);
 
   uint8_t bob_secret_key[32];
-  mlkem::decap(bob_secret_key, cipher, private_key);
+  mlkem::decap<P>(bob_secret_key, cipher, private_key);
   std::cout << std::endl;
   std::cout << "Alice secret key" << std::endl;
   print_bytes(alice_secret_key, 32);